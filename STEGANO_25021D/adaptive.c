@@ -0,0 +1,444 @@
+/*
+Content-adaptive embedding.
+The cost of a pixel stream byte is |right - left| + |below - above| over
+the upper 7 bits of the same channel, so smooth areas (sky, gradients)
+cost little and carry no payload while edges and texture carry it all.
+The encoder picks the highest cost threshold that still holds the
+payload and stores it in the header; the decoder rebuilds the same map
+from the stego pixels. Maps are built and walked in tiles of stream
+rows, spread over worker threads. The first embed/extract for a
+threshold counts the carriers of every tile once, so each tile knows its
+first payload bit; later calls find the tiles of a bit range directly.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "adaptive.h"
+
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+/* Smallest extract share of a thread in payload bytes, shorter reads stay on the calling thread */
+#define ADAPTIVE_EXTRACT_BYTES 512
+
+typedef enum
+{
+    e_pass_cost,
+    e_pass_count,
+    e_pass_embed,
+    e_pass_extract
+} AdaptivePass;
+
+/* Work of one thread: tiles first, first + step, ... */
+typedef struct _AdaptiveJob
+{
+    AdaptiveMap *map;
+    AdaptivePass pass;
+    long first, step;
+    unsigned long hist[256];       // Cost pass
+    const unsigned char *data;     // Embed source, payload bit bit_begin is its MSB
+    unsigned char *out;            // Extract destination, payload bit bit_begin is its MSB
+    long bit_begin, bit_end;       // Payload bits handled by embed/extract
+} AdaptiveJob;
+
+/* Worker thread count, 0 = one per online CPU */
+static int thread_override = 0;
+
+void adaptive_set_threads(int threads)
+{
+    thread_override = threads > 0 ? threads : 0;
+}
+
+int adaptive_parse_args(int argc, char *argv[], AdaptiveMap *map)
+{
+    int j = 0;
+
+    memset(map, 0, sizeof(*map));
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--adaptive") == 0)
+            map->enabled = 1;
+        else
+            argv[j++] = argv[i];
+    }
+    argv[j] = NULL;
+    return j;
+}
+
+#define LANE_LOW7 0x7f7f7f7f7f7f7f7fULL
+#define LANE_HIGH 0x8080808080808080ULL
+
+/* |x - y| of every byte lane, lanes hold 7-bit values */
+static inline uint64_t absdiff7(uint64_t x, uint64_t y)
+{
+    uint64_t xy = (x | LANE_HIGH) - y;                  // x - y + 128, no borrow between lanes
+    uint64_t yx = (y | LANE_HIGH) - x;
+    uint64_t x_ge = ((xy & LANE_HIGH) >> 7) * 0xff;     // 0xff where x >= y
+    return ((xy & x_ge) | (yx & ~x_ge)) & LANE_LOW7;
+}
+
+/* Cost of every byte of one stream row */
+static void cost_row(const AdaptiveMap *map, long file_row)
+{
+    const unsigned char *row = map->pixels + file_row * map->stride;
+    const unsigned char *above = file_row > 0 ? row - map->stride : row;
+    const unsigned char *below = file_row + 1 < map->height ? row + map->stride : row;
+    unsigned char *cost = map->cost + file_row * map->stride;
+    long bpp = map->bpp, width = (long)map->width * bpp;
+
+    // Edge pixels use themselves in place of the missing neighbour
+    for (long i = 0; i < width; i++)
+    {
+        if (i == bpp && width > 2 * bpp)
+            i = width - bpp;
+        long left = i >= bpp ? i - bpp : i;
+        long right = i + bpp < width ? i + bpp : i;
+        int dx = (row[right] >> 1) - (row[left] >> 1);
+        int dy = (below[i] >> 1) - (above[i] >> 1);
+        cost[i] = (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+    }
+    // Interior, 8 bytes per step as packed 7-bit lanes
+    long i = bpp;
+    for (; i + 8 <= width - bpp; i += 8)
+    {
+        uint64_t l, r, a, b;
+        memcpy(&l, row + i - bpp, 8);
+        memcpy(&r, row + i + bpp, 8);
+        memcpy(&a, above + i, 8);
+        memcpy(&b, below + i, 8);
+        uint64_t c = absdiff7((r >> 1) & LANE_LOW7, (l >> 1) & LANE_LOW7) +
+                     absdiff7((b >> 1) & LANE_LOW7, (a >> 1) & LANE_LOW7);
+        memcpy(cost + i, &c, 8);
+    }
+    for (; i < width - bpp; i++)
+    {
+        int dx = (row[i + bpp] >> 1) - (row[i - bpp] >> 1);
+        int dy = (below[i] >> 1) - (above[i] >> 1);
+        cost[i] = (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+    }
+    for (int c = 0; c < bpp; c++)
+    {
+        if (!(map->carrier_mask & (1u << c)))
+        {
+            for (long i = c; i < width; i += bpp)
+                cost[i] = 0;
+        }
+    }
+    memset(cost + width, 0, map->stride - width);
+}
+
+/* Stream bytes [begin, end) of tile t that may carry payload */
+static void tile_span(const AdaptiveMap *map, long t, long *begin, long *end)
+{
+    long tile_bytes = ADAPTIVE_TILE_ROWS * map->stride;
+
+    *begin = t * tile_bytes;
+    *end = *begin + tile_bytes < map->size ? *begin + tile_bytes : map->size;
+    if (*begin < map->start)
+        *begin = *end < map->start ? *end : map->start;
+}
+
+/* Last tile whose first carrier bit is at or before 'bit', empty tiles are skipped that way */
+static long tile_of_bit(const AdaptiveMap *map, long bit)
+{
+    long lo = 0, hi = map->tiles - 1;
+
+    while (lo < hi)
+    {
+        long mid = (lo + hi + 1) / 2;
+        if (map->tile_bits[mid] <= bit)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/* Payload bits [bit_begin, bit_end) packed MSB first into out, bit_begin is a multiple of 8 */
+static void extract_bits(const AdaptiveMap *map, long bit_begin, long bit_end, unsigned char *out)
+{
+    if (bit_begin >= bit_end)
+        return;
+
+    int threshold = map->threshold;
+    unsigned char byte = 0;
+    long t = tile_of_bit(map, bit_begin);
+    long k = map->tile_bits[t];
+
+    for (; t < map->tiles && k < bit_end; t++)
+    {
+        long begin, end;
+        tile_span(map, t, &begin, &end);
+        for (long i = begin; i < end && k < bit_end; i++)
+        {
+            if (map->cost[i] < threshold || k++ < bit_begin)
+                continue;
+            byte = byte << 1 | (map->pixels[i] & 1);
+            if (((k - bit_begin) & 7) == 0)
+                *out++ = byte;
+        }
+    }
+}
+
+static void *adaptive_worker(void *arg)
+{
+    AdaptiveJob *job = arg;
+    AdaptiveMap *map = job->map;
+    int threshold = map->threshold;
+
+    // Extract shares are whole byte ranges, not tiles
+    if (job->pass == e_pass_extract)
+    {
+        extract_bits(map, job->bit_begin, job->bit_end, job->out);
+        return NULL;
+    }
+
+    for (long t = job->first; t < map->tiles; t += job->step)
+    {
+        long begin, end;
+        tile_span(map, t, &begin, &end);
+
+        switch (job->pass)
+        {
+            case e_pass_cost:
+                for (long r = t * ADAPTIVE_TILE_ROWS; r < (t + 1) * ADAPTIVE_TILE_ROWS && r < map->height; r++)
+                    cost_row(map, r);
+                for (long i = begin; i < end; i++)
+                    job->hist[map->cost[i]]++;
+                break;
+
+            case e_pass_count:
+            {
+                long n = 0;
+                for (long i = begin; i < end; i++)
+                    n += map->cost[i] >= threshold;
+                map->tile_bits[t] = n;
+                break;
+            }
+
+            case e_pass_embed:
+            {
+                long k = map->tile_bits[t];
+                if (k >= job->bit_end || (t + 1 < map->tiles && map->tile_bits[t + 1] <= job->bit_begin))
+                    break;
+                for (long i = begin; i < end && k < job->bit_end; i++)
+                {
+                    if (map->cost[i] < threshold)
+                        continue;
+                    long r = k++ - job->bit_begin;
+                    if (r < 0)
+                        continue;
+                    map->pixels[i] = (map->pixels[i] & ~1) | ((job->data[r >> 3] >> (7 - (r & 7))) & 1);
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Run one pass over all tiles, returns the jobs for their results (caller frees).
+ * An extract pass instead splits [bit_begin, bit_end) into byte aligned shares.
+ */
+static AdaptiveJob *run_pass(AdaptiveMap *map, AdaptivePass pass, const unsigned char *data, unsigned char *out,
+                             long bit_begin, long bit_end, long *count)
+{
+    long threads = thread_override ? thread_override : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > ADAPTIVE_MAX_THREADS)
+        threads = ADAPTIVE_MAX_THREADS;
+    if (threads > map->tiles)
+        threads = map->tiles;
+    if (pass == e_pass_extract && threads > (bit_end - bit_begin) / 8 / ADAPTIVE_EXTRACT_BYTES)
+        threads = (bit_end - bit_begin) / 8 / ADAPTIVE_EXTRACT_BYTES;
+    if (threads < 1)
+        threads = 1;
+
+    AdaptiveJob *jobs = calloc(threads, sizeof(AdaptiveJob));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    char *started = calloc(threads, 1);
+    if (!jobs || !ids || !started)
+    {
+        free(jobs);
+        free(ids);
+        free(started);
+        return NULL;
+    }
+
+    long share = ((bit_end - bit_begin) / 8 + threads - 1) / threads * 8;
+    for (long t = 0; t < threads; t++)
+    {
+        jobs[t] = (AdaptiveJob){map, pass, t, threads, {0}, data, out, bit_begin, bit_end};
+        if (pass == e_pass_extract)
+        {
+            jobs[t].out = out + t * share / 8;
+            jobs[t].bit_begin = bit_begin + t * share < bit_end ? bit_begin + t * share : bit_end;
+            jobs[t].bit_end = jobs[t].bit_begin + share < bit_end ? jobs[t].bit_begin + share : bit_end;
+        }
+    }
+    // Job 0 runs on this thread, as does any job whose thread could not be started
+    for (long t = 1; t < threads; t++)
+    {
+        started[t] = pthread_create(&ids[t], NULL, adaptive_worker, &jobs[t]) == 0;
+        if (!started[t])
+            adaptive_worker(&jobs[t]);
+    }
+    adaptive_worker(&jobs[0]);
+    for (long t = 1; t < threads; t++)
+    {
+        if (started[t])
+            pthread_join(ids[t], NULL);
+    }
+
+    free(ids);
+    free(started);
+    *count = threads;
+    return jobs;
+}
+
+Status adaptive_load(AdaptiveMap *map, Cover *cover, long start)
+{
+    long pos = cover->pos;
+
+    map->size = cover->pixel_bytes;
+    map->start = start;
+    map->width = cover->width;
+    map->height = cover->height;
+    map->bpp = cover->bpp;
+    map->stride = cover->stride;
+    map->carrier_mask = 0;
+    for (int c = 0; c < cover->bpp; c++)
+    {
+        if (cover->channels[c] != 'a')
+            map->carrier_mask |= 1u << c;
+    }
+    map->tiles = (cover->height + ADAPTIVE_TILE_ROWS - 1) / ADAPTIVE_TILE_ROWS;
+    map->pixels = malloc(map->size);
+    map->cost = malloc(map->size);
+    map->tile_bits = malloc(sizeof(long) * map->tiles + 1);
+    map->tile_threshold = 0;
+    if (!map->pixels || !map->cost || !map->tile_bits)
+    {
+        printf(RED "ERROR: Memory allocation failed for the cost map.\n" RESET);
+        free_adaptive_map(map);
+        return e_failure;
+    }
+
+    if (cover_seek(cover, 0) != e_success || cover_read(cover, map->pixels, map->size) != map->size ||
+        cover_seek(cover, pos) != e_success)
+    {
+        printf(RED "ERROR: Unable to read the pixel data for the cost map.\n" RESET);
+        free_adaptive_map(map);
+        return e_failure;
+    }
+
+    long count;
+    AdaptiveJob *jobs = run_pass(map, e_pass_cost, NULL, NULL, 0, 0, &count);
+    if (!jobs)
+    {
+        free_adaptive_map(map);
+        return e_failure;
+    }
+    memset(map->hist, 0, sizeof(map->hist));
+    for (long j = 0; j < count; j++)
+    {
+        for (int c = 0; c < 256; c++)
+            map->hist[c] += jobs[j].hist[c];
+    }
+    free(jobs);
+    return e_success;
+}
+
+int adaptive_select_threshold(const AdaptiveMap *map, long size)
+{
+    unsigned long carriers = 0;
+
+    for (int t = 255; t >= 1; t--)
+    {
+        carriers += map->hist[t];
+        if (carriers >= (unsigned long)size * 8)
+            return t;
+    }
+    return 0;
+}
+
+long adaptive_capacity(const AdaptiveMap *map, int threshold)
+{
+    unsigned long carriers = 0;
+
+    for (int t = threshold > 0 ? threshold : 1; t < 256; t++)
+        carriers += map->hist[t];
+    return carriers / 8;
+}
+
+/* First payload bit of every tile for the current threshold, counted once per threshold */
+static Status index_tiles(AdaptiveMap *map)
+{
+    if (map->tile_threshold == map->threshold)
+        return e_success;
+
+    long count;
+    AdaptiveJob *jobs = run_pass(map, e_pass_count, NULL, NULL, 0, 0, &count);
+    if (!jobs)
+        return e_failure;
+    free(jobs);
+
+    long bit = 0;
+    for (long t = 0; t < map->tiles; t++)
+    {
+        long n = map->tile_bits[t];
+        map->tile_bits[t] = bit;
+        bit += n;
+    }
+    map->tile_threshold = map->threshold;
+    return e_success;
+}
+
+Status adaptive_embed(AdaptiveMap *map, long offset, const unsigned char *data, long n)
+{
+    if (offset + n > adaptive_capacity(map, map->threshold) || index_tiles(map) != e_success)
+        return e_failure;
+
+    long count;
+    AdaptiveJob *jobs = run_pass(map, e_pass_embed, data, NULL, offset * 8, (offset + n) * 8, &count);
+    Status ret = jobs ? e_success : e_failure;
+    free(jobs);
+    return ret;
+}
+
+Status adaptive_extract(AdaptiveMap *map, long offset, unsigned char *data, long n)
+{
+    if (offset + n > adaptive_capacity(map, map->threshold) || index_tiles(map) != e_success)
+        return e_failure;
+
+    // Short reads (archive entries, random access) skip the threads altogether
+    if (n < 2 * ADAPTIVE_EXTRACT_BYTES)
+    {
+        extract_bits(map, offset * 8, (offset + n) * 8, data);
+        return e_success;
+    }
+
+    long count;
+    AdaptiveJob *jobs = run_pass(map, e_pass_extract, NULL, data, offset * 8, (offset + n) * 8, &count);
+    Status ret = jobs ? e_success : e_failure;
+    free(jobs);
+    return ret;
+}
+
+void free_adaptive_map(AdaptiveMap *map)
+{
+    free(map->pixels);
+    free(map->cost);
+    free(map->tile_bits);
+    map->pixels = NULL;
+    map->cost = NULL;
+    map->tile_bits = NULL;
+    map->tile_threshold = 0;
+}
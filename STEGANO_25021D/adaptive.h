@@ -0,0 +1,63 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include "types.h"
+#include "cover.h"
+
+/* Stream rows per cost map tile, a tile is the unit of work of a thread */
+#define ADAPTIVE_TILE_ROWS 16
+
+/* Upper bound on worker threads */
+#define ADAPTIVE_MAX_THREADS 16
+
+/*
+ * Content-adaptive carrier selection.
+ * Every pixel stream byte gets a texture cost, the local gradient of the
+ * upper 7 bits, which embedding never changes. Payload bits go, in stream
+ * order, into the bytes at or after 'start' whose cost is at least
+ * 'threshold'. Cost 0 marks bytes that never carry data (flat areas,
+ * alpha, row padding).
+ */
+typedef struct _AdaptiveMap
+{
+    int enabled;             // Payload uses adaptive carriers
+    int threshold;           // Lowest cost of a carrier, stored in the header
+    unsigned char *pixels;   // Whole pixel stream
+    unsigned char *cost;     // Texture cost of every pixel stream byte
+    long size;               // Pixel stream bytes
+    long start;              // First byte that may carry payload (after the header)
+    uint width, height;      // Geometry of the cover
+    int bpp;
+    long stride;
+    uint carrier_mask;       // Channels that can carry data (all but alpha)
+    long tiles;              // Number of ADAPTIVE_TILE_ROWS row tiles
+    long *tile_bits;         // First payload bit of every tile, for tile_threshold
+    int tile_threshold;      // Threshold tile_bits was counted for, 0 = not yet
+    unsigned long hist[256]; // Bytes at or after start by cost
+} AdaptiveMap;
+
+/* Parse and strip --adaptive from argv, returns new argc */
+int adaptive_parse_args(int argc, char *argv[], AdaptiveMap *map);
+
+/* Use this many worker threads (capped as usual), 0 restores one per online CPU */
+void adaptive_set_threads(int threads);
+
+/* Read the whole pixel stream and build its cost map, the stream position is kept */
+Status adaptive_load(AdaptiveMap *map, Cover *cover, long start);
+
+/* Highest threshold whose carriers hold 'size' payload bytes, 0 if none does */
+int adaptive_select_threshold(const AdaptiveMap *map, long size);
+
+/* Payload bytes the carriers of 'threshold' hold */
+long adaptive_capacity(const AdaptiveMap *map, int threshold);
+
+/* Embed payload bytes [offset, offset + n) into map->pixels */
+Status adaptive_embed(AdaptiveMap *map, long offset, const unsigned char *data, long n);
+
+/* Extract payload bytes [offset, offset + n) from map->pixels */
+Status adaptive_extract(AdaptiveMap *map, long offset, unsigned char *data, long n);
+
+/* Release the pixels, the cost map and the tile index */
+void free_adaptive_map(AdaptiveMap *map);
+
+#endif
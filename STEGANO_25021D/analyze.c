@@ -0,0 +1,463 @@
+/*
+LSB steganalysis report.
+Pairs-of-values chi-square (Westfeld/Pfitzmann), RS analysis (Fridrich)
+and sample pair analysis (Dumitrescu) all work from counters that are
+gathered in one pass over the pixels. The analysed rows are split into
+bands, one per worker thread, each with private counters that are summed
+at the end. Histograms are kept as four interleaved sub-histograms so
+runs of equal values do not serialise on one counter.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "analyze.h"
+#include "profile.h"
+
+#define RED "\x1B[31m"
+#define GREEN "\x1B[32m"
+#define YELLOW "\x1B[33m"
+#define RESET "\x1B[0m"
+
+/* Work of one thread: a band of analysed rows */
+typedef struct _AnalyzeTile
+{
+    const AnalyzeInfo *info;
+    const unsigned char *pixels;      // Whole pixel stream
+    uint row_begin, row_end;          // Rows (from the top) of the band
+    LsbStats channel_stats[4];
+    LsbStats grid_stats[ANALYZE_GRID * ANALYZE_GRID];
+    unsigned long hist4[4][4][256];   // [channel][sub-histogram][value]
+} AnalyzeTile;
+
+/* Worker thread count, 0 = one per online CPU */
+static int thread_override = 0;
+
+void analyze_set_threads(int threads)
+{
+    thread_override = threads > 0 ? threads : 0;
+}
+
+int analyze_parse_args(int argc, char *argv[], int *inline_check)
+{
+    int j = 0;
+
+    *inline_check = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--analyze") == 0)
+            *inline_check = 1;
+        else
+            argv[j++] = argv[i];
+    }
+    argv[j] = NULL;
+    return j;
+}
+
+Status read_and_validate_analyze_args(char *argv[], AnalyzeInfo *anaInfo)
+{
+    anaInfo->format = cover_format_for(argv[2]);
+    if (anaInfo->format == NULL)
+    {
+        printf(RED "ERROR: Image file must end with " COVER_SUFFIXES "\n" RESET);
+        return e_failure;
+    }
+    anaInfo->image_fname = argv[2];
+    return e_success;
+}
+
+/* f(G): sum of absolute differences of a group of 4 */
+static int rs_smoothness(const int g[4])
+{
+    return abs(g[1] - g[0]) + abs(g[2] - g[1]) + abs(g[3] - g[2]);
+}
+
+/* Count one group as regular/singular under mask [0 1 1 0], both signs */
+static void rs_count(const int g[4], unsigned long *rs)
+{
+    int f = rs_smoothness(g);
+    int pos[4] = {g[0], g[1] ^ 1, g[2] ^ 1, g[3]};
+    int neg[4] = {g[0], ((g[1] + 1) ^ 1) - 1, ((g[2] + 1) ^ 1) - 1, g[3]};
+    int fp = rs_smoothness(pos), fn = rs_smoothness(neg);
+
+    rs[0] += fp > f;
+    rs[1] += fp < f;
+    rs[2] += fn > f;
+    rs[3] += fn < f;
+}
+
+/*
+ * Values 0/1 and 254/255: flat clipped areas stay in these pairs whatever
+ * their LSBs hold, so groups made only of them are left out of RS and SPA
+ */
+static int saturated(int value)
+{
+    return value <= 1 || value >= 254;
+}
+
+/* Gather the counters of one row of one channel */
+static void analyze_row(const unsigned char *row, uint width, int bpp, LsbStats *stats,
+                        unsigned long hist4[4][256], LsbStats *grid_row, uint grid_width)
+{
+    uint x = 0;
+
+    // Histogram, 4 pixels at a time into separate sub-histograms
+    for (; x + 4 <= width; x += 4)
+    {
+        hist4[0][row[x * bpp]]++;
+        hist4[1][row[(x + 1) * bpp]]++;
+        hist4[2][row[(x + 2) * bpp]]++;
+        hist4[3][row[(x + 3) * bpp]]++;
+    }
+    for (; x < width; x++)
+        hist4[0][row[x * bpp]]++;
+
+    // RS on groups of 4 neighbours, on the image and with all LSBs flipped
+    for (x = 0; x + 4 <= width; x += 4)
+    {
+        int g[4], flipped[4], clipped = 1;
+        for (int i = 0; i < 4; i++)
+        {
+            g[i] = row[(x + i) * bpp];
+            flipped[i] = g[i] ^ 1;
+            clipped &= saturated(g[i]) && (g[i] >> 1) == (g[0] >> 1);
+        }
+        if (clipped)
+            continue;
+        rs_count(g, stats->rs);
+        rs_count(flipped, stats->rs + 4);
+        stats->groups++;
+    }
+
+    // Sample pairs of horizontal neighbours, per grid region as well
+    for (x = 0; x + 1 < width; x++)
+    {
+        int r = row[x * bpp], s = row[(x + 1) * bpp];
+        if (saturated(r) && (r >> 1) == (s >> 1))
+            continue;
+        int close = (s & 1) ? r > s : r < s;
+        int far = (s & 1) ? r < s : r > s;
+        int same = (s >> 1) == (r >> 1);
+        LsbStats *cell = &grid_row[(unsigned long)x * ANALYZE_GRID / grid_width];
+
+        stats->spa_x += close;
+        stats->spa_y += far;
+        stats->spa_k += same;
+        cell->spa_x += close;
+        cell->spa_y += far;
+        cell->spa_k += same;
+        cell->spa_pairs++;
+        stats->spa_pairs++;
+    }
+}
+
+static void *analyze_tile(void *arg)
+{
+    AnalyzeTile *tile = arg;
+    const AnalyzeInfo *info = tile->info;
+    const Cover *cover = &info->cover;
+    const EmbedRegion *region = &info->region;
+
+    for (uint row = tile->row_begin; row < tile->row_end; row++)
+    {
+        if ((row - region->y) % region->row_step != 0)
+            continue;
+
+        uint file_row = cover->bottom_up ? cover->height - 1 - row : row;
+        const unsigned char *line = tile->pixels + file_row * cover->stride + (long)region->x * cover->bpp;
+        LsbStats *grid_row = &tile->grid_stats[(unsigned long)(row - region->y) * ANALYZE_GRID / region->height * ANALYZE_GRID];
+
+        for (int c = 0; c < cover->bpp; c++)
+        {
+            if (region->channel_mask & (1u << c))
+                analyze_row(line + c, region->width, cover->bpp, &tile->channel_stats[c], tile->hist4[c], grid_row, region->width);
+        }
+    }
+
+    for (int c = 0; c < cover->bpp; c++)
+    {
+        for (int v = 0; v < 256; v++)
+            tile->channel_stats[c].hist[v] = tile->hist4[c][0][v] + tile->hist4[c][1][v] + tile->hist4[c][2][v] + tile->hist4[c][3][v];
+    }
+    return NULL;
+}
+
+static void add_lsb_stats(LsbStats *dest, const LsbStats *src)
+{
+    for (int v = 0; v < 256; v++)
+        dest->hist[v] += src->hist[v];
+    for (int i = 0; i < 8; i++)
+        dest->rs[i] += src->rs[i];
+    dest->groups += src->groups;
+    dest->spa_x += src->spa_x;
+    dest->spa_y += src->spa_y;
+    dest->spa_k += src->spa_k;
+    dest->spa_pairs += src->spa_pairs;
+}
+
+/* Regularised upper incomplete gamma Q(a, x) */
+static double gamma_q(double a, double x)
+{
+    if (x <= 0)
+        return 1.0;
+
+    double front = exp(-x + a * log(x) - lgamma(a));
+    if (x < a + 1)
+    {
+        double term = 1.0 / a, sum = term;
+        for (int n = 1; n < 1000 && fabs(term) > fabs(sum) * 1e-14; n++)
+        {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return 1.0 - front * sum;
+    }
+
+    // Continued fraction, modified Lentz
+    double b = x + 1 - a, c = 1e300, d = 1 / b, h = d;
+    for (int i = 1; i < 1000; i++)
+    {
+        double an = -i * (i - a);
+        b += 2;
+        d = an * d + b;
+        if (fabs(d) < 1e-300)
+            d = 1e-300;
+        c = b + an / c;
+        if (fabs(c) < 1e-300)
+            c = 1e-300;
+        d = 1 / d;
+        h *= d * c;
+        if (fabs(d * c - 1) < 1e-14)
+            break;
+    }
+    return front * h;
+}
+
+static double clamp_rate(double rate)
+{
+    if (rate != rate || rate < 0)
+        return 0;
+    return rate > 1 ? 1 : rate;
+}
+
+void score_lsb_stats(const LsbStats *stats, LsbScore *score)
+{
+    // Chi-square over value pairs (2k, 2k+1) with enough samples
+    double chi = 0;
+    int categories = 0;
+    for (int k = 0; k < 128; k++)
+    {
+        double expected = (stats->hist[2 * k] + stats->hist[2 * k + 1]) / 2.0;
+        if (expected < 5)
+            continue;
+        double diff = stats->hist[2 * k] - expected;
+        chi += diff * diff / expected;
+        categories++;
+    }
+    score->chi_p = categories > 1 ? gamma_q((categories - 1) / 2.0, chi / 2) : 0;
+
+    // RS: solve 2(d1 + d0)z^2 + (d-0 - d-1 - d1 - 3d0)z + d0 - d-0 = 0, rate = z / (z - 1/2)
+    score->rs_rate = 0;
+    if (stats->groups > 0)
+    {
+        double n = stats->groups;
+        double d0 = (stats->rs[0] - (double)stats->rs[1]) / n;
+        double dn0 = (stats->rs[2] - (double)stats->rs[3]) / n;
+        double d1 = (stats->rs[4] - (double)stats->rs[5]) / n;
+        double dn1 = (stats->rs[6] - (double)stats->rs[7]) / n;
+        double a = 2 * (d1 + d0), b = dn0 - dn1 - d1 - 3 * d0, c = d0 - dn0;
+        double z;
+
+        if (fabs(a) < 1e-12)
+            z = fabs(b) > 1e-12 ? -c / b : 0;
+        else
+        {
+            double disc = b * b - 4 * a * c;
+            disc = disc > 0 ? sqrt(disc) : 0;
+            double z1 = (-b + disc) / (2 * a), z2 = (-b - disc) / (2 * a);
+            z = fabs(z1) < fabs(z2) ? z1 : z2;
+        }
+        score->rs_rate = clamp_rate(z / (z - 0.5));
+    }
+
+    score->spa_rate = 0;
+    if (stats->spa_k > 0)
+    {
+        double a = 2.0 * stats->spa_k;
+        double b = 2.0 * (2.0 * stats->spa_x - stats->spa_pairs);
+        double c = (double)stats->spa_y - stats->spa_x;
+        double disc = b * b - 4 * a * c;
+        disc = disc > 0 ? sqrt(disc) : 0;
+        double bp = (-b + disc) / (2 * a), bm = (-b - disc) / (2 * a);
+        score->spa_rate = clamp_rate(2 * (bp < bm ? bp : bm));
+    }
+}
+
+/* Run the tiles, one thread per band of rows */
+static Status analyze_pixels(AnalyzeInfo *anaInfo, const unsigned char *pixels)
+{
+    const EmbedRegion *region = &anaInfo->region;
+    long threads = thread_override ? thread_override : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > ANALYZE_MAX_THREADS)
+        threads = ANALYZE_MAX_THREADS;
+    if (threads > (long)region->height / 16)
+        threads = region->height / 16;
+    if (threads < 1)
+        threads = 1;
+
+    AnalyzeTile *tiles = calloc(threads, sizeof(AnalyzeTile));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    char *started = calloc(threads, 1);
+    if (!tiles || !ids || !started)
+    {
+        printf(RED "ERROR: Memory allocation failed for analysis tiles.\n" RESET);
+        free(tiles);
+        free(ids);
+        free(started);
+        return e_failure;
+    }
+
+    for (long t = 0; t < threads; t++)
+    {
+        tiles[t].info = anaInfo;
+        tiles[t].pixels = pixels;
+        tiles[t].row_begin = region->y + region->height * t / threads;
+        tiles[t].row_end = region->y + region->height * (t + 1) / threads;
+    }
+    // Tile 0 runs on this thread, as does any tile whose thread could not be started
+    for (long t = 1; t < threads; t++)
+    {
+        started[t] = pthread_create(&ids[t], NULL, analyze_tile, &tiles[t]) == 0;
+        if (!started[t])
+            analyze_tile(&tiles[t]);
+    }
+    analyze_tile(&tiles[0]);
+
+    memset(anaInfo->channel_stats, 0, sizeof(anaInfo->channel_stats));
+    memset(anaInfo->grid_stats, 0, sizeof(anaInfo->grid_stats));
+    for (long t = 0; t < threads; t++)
+    {
+        if (started[t])
+            pthread_join(ids[t], NULL);
+        for (int c = 0; c < 4; c++)
+            add_lsb_stats(&anaInfo->channel_stats[c], &tiles[t].channel_stats[c]);
+        for (int g = 0; g < ANALYZE_GRID * ANALYZE_GRID; g++)
+            add_lsb_stats(&anaInfo->grid_stats[g], &tiles[t].grid_stats[g]);
+    }
+    free(tiles);
+    free(ids);
+    free(started);
+    return e_success;
+}
+
+static void print_report(AnalyzeInfo *anaInfo)
+{
+    const Cover *cover = &anaInfo->cover;
+    const EmbedRegion *region = &anaInfo->region;
+    LsbScore score;
+
+    printf("LSB analysis of %s, region %u,%u %ux%u\n", anaInfo->image_fname, region->x, region->y, region->width, region->height);
+    printf("%-8s %12s %10s %10s\n", "Channel", "Chi-square p", "RS rate", "SPA rate");
+    anaInfo->flagged = 0;
+    for (int c = 0; c < cover->bpp; c++)
+    {
+        if (!(region->channel_mask & (1u << c)))
+            continue;
+        score_lsb_stats(&anaInfo->channel_stats[c], &score);
+        int alert = score.chi_p > ANALYZE_ALERT_P || score.rs_rate > ANALYZE_ALERT_RATE || score.spa_rate > ANALYZE_ALERT_RATE;
+        anaInfo->flagged += alert;
+        printf("%s%-8c %12.4f %10.4f %10.4f%s\n" RESET, alert ? YELLOW : "", cover->channels[c],
+               score.chi_p, score.rs_rate, score.spa_rate, alert ? "  <- flagged" : "");
+    }
+
+    printf("SPA rate by region (%dx%d grid, all channels):\n", ANALYZE_GRID, ANALYZE_GRID);
+    for (int gy = 0; gy < ANALYZE_GRID; gy++)
+    {
+        for (int gx = 0; gx < ANALYZE_GRID; gx++)
+        {
+            score_lsb_stats(&anaInfo->grid_stats[gy * ANALYZE_GRID + gx], &score);
+            int alert = score.spa_rate > ANALYZE_ALERT_RATE;
+            anaInfo->flagged += alert;
+            printf("%s %8.4f" RESET, alert ? YELLOW : "", score.spa_rate);
+        }
+        printf("\n");
+    }
+
+    if (anaInfo->flagged)
+        printf(YELLOW "%d channel(s)/region(s) show LSB embedding.\n" RESET, anaInfo->flagged);
+    else
+        printf(GREEN "No LSB embedding detected.\n" RESET);
+}
+
+Status do_analysis(AnalyzeInfo *anaInfo)
+{
+    Cover *cover = &anaInfo->cover;
+    EmbedRegion *region = &anaInfo->region;
+
+    anaInfo->fptr_image = fopen(anaInfo->image_fname, "rb");
+    if (anaInfo->fptr_image == NULL)
+    {
+        perror("fopen");
+        printf(RED "ERROR: Unable to open file %s\n" RESET, anaInfo->image_fname);
+        return e_failure;
+    }
+    if (cover_open(cover, anaInfo->format, anaInfo->fptr_image, &anaInfo->raw_geometry) != e_success)
+    {
+        printf(RED "ERROR: %s is not a supported %s image\n" RESET, anaInfo->image_fname, anaInfo->format->name);
+        fclose(anaInfo->fptr_image);
+        return e_failure;
+    }
+
+    // Whole image and every colour channel unless a region was given
+    if (region->enabled)
+    {
+        region->channel_mask = cover_channel_mask(cover, region->channels);
+    }
+    else
+    {
+        memset(region, 0, sizeof(*region));
+        region->row_step = 1;
+        for (int c = 0; c < cover->bpp; c++)
+        {
+            if (cover->channels[c] != 'a' || cover->bpp == 1)
+                region->channel_mask |= 1u << c;
+        }
+    }
+    Status ret = validate_region(region, cover);
+
+    unsigned char *pixels = ret == e_success ? malloc(cover->pixel_bytes) : NULL;
+    if (ret == e_success && pixels == NULL)
+    {
+        printf(RED "ERROR: Memory allocation failed for pixel data.\n" RESET);
+        ret = e_failure;
+    }
+
+    if (ret == e_success)
+    {
+        profile_begin("read_pixels", &cover->pos);
+        if (cover_read(cover, pixels, cover->pixel_bytes) != cover->pixel_bytes)
+        {
+            printf(RED "ERROR: Image truncated inside pixel data.\n" RESET);
+            ret = e_failure;
+        }
+        profile_end(&cover->pos);
+    }
+    if (ret == e_success)
+    {
+        profile_begin("analyze_pixels", NULL);
+        ret = analyze_pixels(anaInfo, pixels);
+        profile_end(NULL);
+    }
+    if (ret == e_success)
+    {
+        print_report(anaInfo);
+    }
+
+    free(pixels);
+    cover_close(cover);
+    fclose(anaInfo->fptr_image);
+    return ret;
+}
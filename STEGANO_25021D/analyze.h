@@ -0,0 +1,73 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stdio.h>
+#include "types.h"
+#include "cover.h"
+#include "region.h"
+
+/* The analysed rectangle is also scored as a GRID x GRID set of regions */
+#define ANALYZE_GRID 4
+
+/* Upper bound on worker threads (tiles are bands of rows) */
+#define ANALYZE_MAX_THREADS 16
+
+/* Estimated embedding rate above which a channel or region is flagged */
+#define ANALYZE_ALERT_RATE 0.10
+
+/* Chi-square p-value above which a channel is flagged */
+#define ANALYZE_ALERT_P 0.95
+
+/*
+ * Counters of one channel (or grid region) gathered in a single pass.
+ * hist: value histogram, for the pairs-of-values chi-square test
+ * rs: regular/singular groups for masks +M/-M, on the image and on the
+ *     image with every LSB flipped (RS analysis)
+ * spa: close/far pair counts of horizontal neighbours (sample pairs)
+ */
+typedef struct _LsbStats
+{
+    unsigned long hist[256];
+    unsigned long rs[8];     // R+M S+M R-M S-M, then the same on the flipped image
+    unsigned long groups;    // RS groups counted
+    unsigned long spa_x, spa_y, spa_k, spa_pairs;
+} LsbStats;
+
+/* Detector outputs, rates are the estimated fraction of LSBs carrying data */
+typedef struct _LsbScore
+{
+    double chi_p;            // Pairs-of-values p-value, near 1 = equalised pairs
+    double rs_rate;          // RS estimate
+    double spa_rate;         // Sample pair estimate
+} LsbScore;
+
+typedef struct _AnalyzeInfo
+{
+    char *image_fname;
+    FILE *fptr_image;
+    const CoverFormat *format;
+    CoverGeometry raw_geometry;  // --raw geometry of a .raw image
+    Cover cover;
+    EmbedRegion region;      // Rectangle/channels analysed (whole image if not enabled)
+
+    LsbStats channel_stats[4];
+    LsbStats grid_stats[ANALYZE_GRID * ANALYZE_GRID];   // All channels summed
+    int flagged;             // Number of channels/regions over the alert levels
+} AnalyzeInfo;
+
+/* Parse and strip --analyze (check encoder output) from argv, returns new argc */
+int analyze_parse_args(int argc, char *argv[], int *inline_check);
+
+/* Use this many worker threads (capped as usual), 0 restores one per online CPU */
+void analyze_set_threads(int threads);
+
+/* Read and validate -a <image> arguments */
+Status read_and_validate_analyze_args(char *argv[], AnalyzeInfo *anaInfo);
+
+/* Run all detectors over the image and print the report */
+Status do_analysis(AnalyzeInfo *anaInfo);
+
+/* Turn the counters into detector scores */
+void score_lsb_stats(const LsbStats *stats, LsbScore *score);
+
+#endif
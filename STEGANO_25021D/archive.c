@@ -0,0 +1,255 @@
+/*
+Multi-file archive payload.
+The encoder writes the index and the data of every file into one
+payload, which is then embedded like a single secret file. The decoder
+reads the index first and can then pull any entry straight from its
+span of the cover.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <zlib.h>
+#include "archive.h"
+
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+static uint get_be32(const unsigned char *p)
+{
+    return ((uint)p[0] << 24) | ((uint)p[1] << 16) | ((uint)p[2] << 8) | p[3];
+}
+
+static void put_be32(unsigned char *p, uint v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/* Plain file name: printable, no path separators, no leading dot (so not . or .. either) */
+static int archive_valid_name(const char *name, long len)
+{
+    if (len == 0 || len > MAX_ENTRY_NAME || name[0] == '.')
+        return 0;
+    for (long i = 0; i < len; i++)
+    {
+        if (!isprint((unsigned char)name[i]) || name[i] == '/' || name[i] == '\\')
+            return 0;
+    }
+    return 1;
+}
+
+uint archive_checksum(const unsigned char *data, long size)
+{
+    return crc32(crc32(0L, Z_NULL, 0), data, size);
+}
+
+/* Size and checksum of one file */
+static Status archive_scan_file(const char *fname, ArchiveEntry *entry)
+{
+    unsigned char buffer[4096];
+    size_t n;
+
+    FILE *fptr = fopen(fname, "rb");
+    if (fptr == NULL)
+    {
+        perror("fopen");
+        fprintf(stderr, RED "ERROR: Unable to open file %s\n" RESET, fname);
+        return e_failure;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    entry->size = 0;
+    while ((n = fread(buffer, 1, sizeof(buffer), fptr)) > 0)
+    {
+        crc = crc32(crc, buffer, n);
+        entry->size += n;
+    }
+    entry->crc = crc;
+    fclose(fptr);
+    return e_success;
+}
+
+/* Append one file's data */
+static Status archive_copy_file(const char *fname, FILE *dest)
+{
+    unsigned char buffer[4096];
+    size_t n;
+
+    FILE *fptr = fopen(fname, "rb");
+    if (fptr == NULL)
+        return e_failure;
+    while ((n = fread(buffer, 1, sizeof(buffer), fptr)) > 0)
+    {
+        if (fwrite(buffer, 1, n, dest) != n)
+        {
+            fclose(fptr);
+            return e_failure;
+        }
+    }
+    fclose(fptr);
+    return e_success;
+}
+
+Status archive_write(char *files[], int count, FILE *fptr)
+{
+    ArchiveEntry *entries = calloc(count, sizeof(ArchiveEntry));
+    if (entries == NULL)
+    {
+        fprintf(stderr, RED "ERROR: Memory allocation failed.\n" RESET);
+        return e_failure;
+    }
+
+    // Pass 1: names, sizes and checksums, to lay out the table
+    long table_bytes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const char *name = strrchr(files[i], '/') ? strrchr(files[i], '/') + 1 : files[i];
+        if (!archive_valid_name(name, strlen(name)))
+        {
+            fprintf(stderr, RED "ERROR: %s cannot be stored, names are at most %d plain characters and do not start with a dot\n" RESET, files[i], MAX_ENTRY_NAME);
+            free(entries);
+            return e_failure;
+        }
+        for (int j = 0; j < i; j++)
+        {
+            if (strcmp(entries[j].name, name) == 0)
+            {
+                fprintf(stderr, RED "ERROR: Two files named %s\n" RESET, name);
+                free(entries);
+                return e_failure;
+            }
+        }
+        strcpy(entries[i].name, name);
+        if (archive_scan_file(files[i], &entries[i]) != e_success)
+        {
+            free(entries);
+            return e_failure;
+        }
+        table_bytes += 1 + strlen(name) + 12;
+    }
+
+    // Prefix and table
+    unsigned char field[4];
+    long offset = ARCHIVE_PREFIX_BYTES + table_bytes;
+    int ok = 1;
+
+    put_be32(field, count);
+    ok &= fwrite(field, 1, 4, fptr) == 4;
+    put_be32(field, table_bytes);
+    ok &= fwrite(field, 1, 4, fptr) == 4;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned char len = strlen(entries[i].name);
+        entries[i].offset = offset;
+        offset += entries[i].size;
+
+        ok &= fwrite(&len, 1, 1, fptr) == 1;
+        ok &= fwrite(entries[i].name, 1, len, fptr) == len;
+        put_be32(field, entries[i].offset);
+        ok &= fwrite(field, 1, 4, fptr) == 4;
+        put_be32(field, entries[i].size);
+        ok &= fwrite(field, 1, 4, fptr) == 4;
+        put_be32(field, entries[i].crc);
+        ok &= fwrite(field, 1, 4, fptr) == 4;
+    }
+
+    // Pass 2: the data
+    for (int i = 0; i < count && ok; i++)
+    {
+        ok = archive_copy_file(files[i], fptr) == e_success;
+        printf("Archived %s (%ld bytes)\n", entries[i].name, entries[i].size);
+    }
+
+    free(entries);
+    if (!ok || offset > 0x7FFFFFFF)
+    {
+        fprintf(stderr, RED "ERROR: Unable to build the archive payload.\n" RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status archive_read_prefix(const unsigned char *prefix, long payload_size, ArchiveIndex *index)
+{
+    index->entries = NULL;
+    index->count = get_be32(prefix);
+    index->table_bytes = get_be32(prefix + 4);
+
+    // Every entry takes at least 14 table bytes
+    if (index->table_bytes > payload_size - ARCHIVE_PREFIX_BYTES ||
+        index->count > index->table_bytes / 14)
+    {
+        printf(RED "ERROR: Archive index is damaged.\n" RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status archive_parse_table(const unsigned char *table, long payload_size, ArchiveIndex *index)
+{
+    long data_start = ARCHIVE_PREFIX_BYTES + index->table_bytes;
+    long pos = 0;
+    int ok = 1;
+
+    index->entries = calloc(index->count ? index->count : 1, sizeof(ArchiveEntry));
+    if (index->entries == NULL)
+    {
+        printf(RED "ERROR: Memory allocation failed for archive index.\n" RESET);
+        return e_failure;
+    }
+
+    for (long i = 0; i < index->count; i++)
+    {
+        ArchiveEntry *entry = &index->entries[i];
+        long len = pos < index->table_bytes ? table[pos] : 0;
+
+        if (pos + 1 + len + 12 > index->table_bytes || !archive_valid_name((const char *)table + pos + 1, len))
+        {
+            ok = 0;
+            break;
+        }
+        memcpy(entry->name, table + pos + 1, len);
+        entry->name[len] = '\0';
+        pos += 1 + len;
+
+        entry->offset = get_be32(table + pos);
+        entry->size = get_be32(table + pos + 4);
+        entry->crc = get_be32(table + pos + 8);
+        pos += 12;
+
+        if (entry->offset < data_start || entry->size > payload_size - entry->offset)
+        {
+            ok = 0;
+            break;
+        }
+    }
+
+    if (!ok || pos != index->table_bytes)
+    {
+        printf(RED "ERROR: Archive index is damaged.\n" RESET);
+        free_archive_index(index);
+        return e_failure;
+    }
+    return e_success;
+}
+
+const ArchiveEntry *archive_find(const ArchiveIndex *index, const char *name)
+{
+    for (long i = 0; i < index->count; i++)
+    {
+        if (strcmp(index->entries[i].name, name) == 0)
+            return &index->entries[i];
+    }
+    return NULL;
+}
+
+void free_archive_index(ArchiveIndex *index)
+{
+    free(index->entries);
+    index->entries = NULL;
+    index->count = 0;
+}
@@ -0,0 +1,66 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdio.h>
+#include "types.h"
+#include "common.h"
+
+/* Name the header records for an archive payload (its extension is stored) */
+#define ARCHIVE_NAME "archive.sga"
+
+/* Entry count + entry table size, in front of the table */
+#define ARCHIVE_PREFIX_BYTES 8
+
+/* Longest entry name, an extracted entry must fit the decoder's file name */
+#define MAX_ENTRY_NAME (MAX_FNAME_SIZE + MAX_EXTN_SIZE)
+
+/*
+ * Multi-file payload layout (integers big-endian):
+ *   u32 entry count, u32 entry table bytes
+ *   per entry: u8 name length, name, u32 offset, u32 size, u32 CRC-32
+ *   file data, back to back
+ * Offsets are from the start of the payload, so an entry maps straight
+ * onto a span of the cover without reading anything before it.
+ */
+typedef struct _ArchiveEntry
+{
+    char name[MAX_ENTRY_NAME + 1];
+    long offset;             // Payload offset of the data
+    long size;               // Data bytes
+    uint crc;                // CRC-32 of the data
+} ArchiveEntry;
+
+typedef struct _ArchiveIndex
+{
+    ArchiveEntry *entries;
+    long count;
+    long table_bytes;        // Entry table size, follows the prefix
+} ArchiveIndex;
+
+/* What the decoder does with an archive payload */
+typedef enum
+{
+    e_archive_extract_all,
+    e_archive_list,
+    e_archive_extract_one
+} ArchiveAction;
+
+/* Write the payload for 'count' files (index, then their data) to fptr */
+Status archive_write(char *files[], int count, FILE *fptr);
+
+/* Read the prefix, sets count and table_bytes */
+Status archive_read_prefix(const unsigned char *prefix, long payload_size, ArchiveIndex *index);
+
+/* Parse the entry table (table_bytes bytes) into index->entries */
+Status archive_parse_table(const unsigned char *table, long payload_size, ArchiveIndex *index);
+
+/* Entry with this name, NULL if there is none */
+const ArchiveEntry *archive_find(const ArchiveIndex *index, const char *name);
+
+/* Checksum stored for each entry */
+uint archive_checksum(const unsigned char *data, long size);
+
+/* Release the entries of an index */
+void free_archive_index(ArchiveIndex *index);
+
+#endif
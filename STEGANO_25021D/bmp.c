@@ -0,0 +1,62 @@
+/*
+BMP cover format.
+Uncompressed 24-bit (BGR) and 32-bit (BGRA) bitmaps. The pixel stream is
+the raw row data, padding included, starting at the offset stored in the
+file header. Rows are bottom-up unless the height is negative.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "cover.h"
+
+/* Get image size
+ * Input: Cover with an open BMP file
+ * Description: In BMP Image, the pixel data offset is stored at 10,
+ * width at offset 18 and height after that, bits per pixel at 28
+ */
+static Status bmp_read_header(Cover *cover)
+{
+    unsigned char header[54];
+    uint data_offset, compression;
+    int width, height;
+    unsigned short bits;
+
+    rewind(cover->fptr);
+    if (fread(header, 1, sizeof(header), cover->fptr) != sizeof(header) ||
+        header[0] != 'B' || header[1] != 'M')
+    {
+        return e_failure;
+    }
+
+    memcpy(&data_offset, header + 10, sizeof(data_offset));
+    memcpy(&width, header + 18, sizeof(width));
+    memcpy(&height, header + 22, sizeof(height));
+    memcpy(&bits, header + 28, sizeof(bits));
+    memcpy(&compression, header + 30, sizeof(compression));
+
+    // Only uncompressed true colour (BI_BITFIELDS is fine for 32-bit).
+    // A top-down height of INT_MIN has no positive row count
+    if ((bits != 24 && bits != 32) || (compression != 0 && !(bits == 32 && compression == 3)) ||
+        width <= 0 || height == 0 || height == INT_MIN || data_offset < sizeof(header))
+    {
+        return e_failure;
+    }
+
+    cover->width = width;
+    cover->height = height > 0 ? height : -height;
+    cover->bottom_up = height > 0;
+    cover->bpp = bits / 8;
+    cover->channels = cover->bpp == 3 ? "bgr" : "bgra";
+    cover->stride = ((long)width * cover->bpp + 3) & ~3L;
+    cover->pixel_bytes = cover->stride * cover->height;
+
+    return plain_cover_init(cover, data_offset);
+}
+
+const CoverFormat bmp_format = {
+    "BMP", ".bmp", "stego.bmp", 1,
+    bmp_read_header, plain_write_header,
+    plain_read, plain_write, plain_seek,
+    plain_finish, plain_release
+};
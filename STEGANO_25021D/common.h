@@ -2,6 +2,28 @@
 #define COMMON_H
 
 /* Magic string to identify whether stegged or not */
-#define MAGIC_STRING "#*"
+#define MAGIC_STRING "#*SG"
+
+/* Header format version, stored right after the magic string */
+#define STEGO_VERSION 2
+
+/* Header flags byte, stored right after the version */
+#define STEGO_FLAG_REGION 0x01   // Channel/region layout block follows
+#define STEGO_FLAG_FEC    0x02   // FEC parity byte follows, payload is RS coded
+#define STEGO_FLAG_ARCHIVE 0x04  // Payload is a multi-file archive
+#define STEGO_FLAG_ADAPTIVE 0x08 // Cost threshold byte follows, payload uses adaptive carriers
+#define STEGO_FLAG_DIGEST 0x10   // CRC-32 of the secret data follows (32 bits)
+
+/* Default embed layout: 1 LSB per channel */
+#define DEFAULT_LSB_BITS 1
+
+/* Secret data bytes embedded/extracted per chunk */
+#define DATA_CHUNK_SIZE 4096
+
+/* Longest secret file extension (including the '.') we store */
+#define MAX_EXTN_SIZE 7
+
+/* Longest output base name accepted on the command line */
+#define MAX_FNAME_SIZE 64
 
 #endif
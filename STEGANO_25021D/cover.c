@@ -0,0 +1,220 @@
+/*
+Cover image front end.
+Encoding and decoding only ever see a stream of pixel bytes. Each format
+(bmp.c, png.c, pnm.c, tga.c, raw.c) knows how to parse and write its own
+header and how to produce and consume that stream, so the embed/extract
+core is shared. Formats that store pixels uncompressed at a fixed file
+offset only parse their header and use the plain_* helpers below for
+everything else.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "cover.h"
+
+static const CoverFormat *cover_formats[] = {
+    &bmp_format,
+    &png_format,
+    &ppm_format,
+    &pgm_format,
+    &tga_format,
+    &raw_format
+};
+
+typedef struct _PlainState
+{
+    long data_offset;        // File offset of the first pixel byte
+} PlainState;
+
+const CoverFormat *cover_format_for(const char *fname)
+{
+    int len = strlen(fname);
+
+    for (size_t i = 0; i < sizeof(cover_formats) / sizeof(cover_formats[0]); i++)
+    {
+        int slen = strlen(cover_formats[i]->suffix);
+        if (len > slen && strcmp(fname + len - slen, cover_formats[i]->suffix) == 0)
+            return cover_formats[i];
+    }
+    return NULL;
+}
+
+Status cover_open(Cover *cover, const CoverFormat *format, FILE *fptr, const CoverGeometry *geometry)
+{
+    memset(cover, 0, sizeof(*cover));
+    cover->format = format;
+    cover->fptr = fptr;
+    if (geometry)
+        cover->geometry = *geometry;
+    return format->read_header(cover);
+}
+
+Status cover_create(Cover *dest, Cover *src, FILE *fptr)
+{
+    memset(dest, 0, sizeof(*dest));
+    dest->format = src->format;
+    dest->fptr = fptr;
+    dest->width = src->width;
+    dest->height = src->height;
+    dest->bottom_up = src->bottom_up;
+    dest->bpp = src->bpp;
+    dest->channels = src->channels;
+    dest->stride = src->stride;
+    dest->pixel_bytes = src->pixel_bytes;
+    dest->geometry = src->geometry;
+    return src->format->write_header(dest, src);
+}
+
+long cover_read(Cover *cover, unsigned char *buf, long n)
+{
+    if (n > cover->pixel_bytes - cover->pos)
+        n = cover->pixel_bytes - cover->pos;
+    if (n <= 0)
+        return 0;
+
+    long got = cover->format->read(cover, buf, n);
+    if (got > 0)
+        cover->pos += got;
+    return got;
+}
+
+Status cover_write(Cover *cover, const unsigned char *buf, long n)
+{
+    if (n > cover->pixel_bytes - cover->pos || cover->format->write(cover, buf, n) != e_success)
+        return e_failure;
+    cover->pos += n;
+    return e_success;
+}
+
+Status cover_seek(Cover *cover, long offset)
+{
+    if (offset < 0 || offset > cover->pixel_bytes || cover->format->seek(cover, offset) != e_success)
+        return e_failure;
+    cover->pos = offset;
+    return e_success;
+}
+
+Status cover_copy(Cover *src, Cover *dest, long n)
+{
+    unsigned char buffer[4096];
+
+    while (n > 0)
+    {
+        long chunk = n < (long)sizeof(buffer) ? n : (long)sizeof(buffer);
+        if (cover_read(src, buffer, chunk) != chunk || cover_write(dest, buffer, chunk) != e_success)
+            return e_failure;
+        n -= chunk;
+    }
+    return e_success;
+}
+
+Status cover_finish(Cover *dest, Cover *src)
+{
+    if (cover_copy(src, dest, src->pixel_bytes - src->pos) != e_success)
+        return e_failure;
+    return src->format->finish(dest, src);
+}
+
+void cover_close(Cover *cover)
+{
+    if (cover->format && cover->format->release)
+        cover->format->release(cover);
+    cover->state = NULL;
+}
+
+uint cover_channel_mask(const Cover *cover, const char *letters)
+{
+    uint mask = 0;
+
+    for (const char *c = letters; *c; c++)
+    {
+        const char *at = strchr(cover->channels, tolower((unsigned char)*c));
+        if (at == NULL)
+            return 0;
+        mask |= 1u << (at - cover->channels);
+    }
+    return mask;
+}
+
+Status plain_cover_init(Cover *cover, long data_offset)
+{
+    fseek(cover->fptr, 0, SEEK_END);
+    if (cover->pixel_bytes <= 0 || ftell(cover->fptr) < data_offset + cover->pixel_bytes)
+        return e_failure;
+
+    PlainState *state = malloc(sizeof(PlainState));
+    if (state == NULL)
+        return e_failure;
+    state->data_offset = data_offset;
+    cover->state = state;
+
+    fseek(cover->fptr, data_offset, SEEK_SET);
+    return e_success;
+}
+
+/* Copy the header (everything before the pixel data) */
+Status plain_write_header(Cover *dest, Cover *src)
+{
+    long data_offset = ((PlainState *)src->state)->data_offset;
+    unsigned char buffer[1024];
+    long done = 0;
+
+    rewind(src->fptr);
+    while (done < data_offset)
+    {
+        long chunk = data_offset - done < (long)sizeof(buffer) ? data_offset - done : (long)sizeof(buffer);
+        if (fread(buffer, 1, chunk, src->fptr) != (size_t)chunk ||
+            fwrite(buffer, 1, chunk, dest->fptr) != (size_t)chunk)
+        {
+            return e_failure;
+        }
+        done += chunk;
+    }
+
+    PlainState *state = malloc(sizeof(PlainState));
+    if (state == NULL)
+        return e_failure;
+    state->data_offset = data_offset;
+    dest->state = state;
+
+    // Source stays positioned at pixel byte src->pos
+    fseek(src->fptr, data_offset + src->pos, SEEK_SET);
+    return e_success;
+}
+
+long plain_read(Cover *cover, unsigned char *buf, long n)
+{
+    return fread(buf, 1, n, cover->fptr);
+}
+
+Status plain_write(Cover *cover, const unsigned char *buf, long n)
+{
+    return fwrite(buf, 1, n, cover->fptr) == (size_t)n ? e_success : e_failure;
+}
+
+Status plain_seek(Cover *cover, long offset)
+{
+    long data_offset = ((PlainState *)cover->state)->data_offset;
+    return fseek(cover->fptr, data_offset + offset, SEEK_SET) == 0 ? e_success : e_failure;
+}
+
+/* Copy any bytes that follow the pixel data (footers, extra chunks) */
+Status plain_finish(Cover *dest, Cover *src)
+{
+    char buffer[1024];
+    size_t n;
+
+    while ((n = fread(buffer, 1, sizeof(buffer), src->fptr)) > 0)
+    {
+        if (fwrite(buffer, 1, n, dest->fptr) != n)
+            return e_failure;
+    }
+    return e_success;
+}
+
+void plain_release(Cover *cover)
+{
+    free(cover->state);
+}
@@ -0,0 +1,126 @@
+#ifndef COVER_H
+#define COVER_H
+
+#include <stdio.h>
+#include "types.h"
+
+struct _CoverFormat;
+
+/* Geometry given on the command line for covers whose files do not store it (.raw) */
+typedef struct _CoverGeometry
+{
+    uint width;
+    uint height;
+    int bpp;                 // 0 = none given, -1 = malformed --raw
+} CoverGeometry;
+
+/*
+ * An open cover image seen as one stream of pixel bytes.
+ * Stego header and payload offsets are positions in this stream,
+ * whatever the container format looks like on disk.
+ */
+typedef struct _Cover
+{
+    const struct _CoverFormat *format;
+    FILE *fptr;
+    uint width;              // Pixels per row
+    uint height;             // Number of rows
+    int bottom_up;           // First row of the stream is the bottom row
+    int bpp;                 // Bytes per pixel
+    const char *channels;    // Channel letters in memory order, e.g. "bgr"
+    long stride;             // Stream bytes per row, including padding
+    long pixel_bytes;        // Total bytes in the pixel stream
+    long pos;                // Current offset in the pixel stream
+    CoverGeometry geometry;  // From --raw, used by formats without a header
+    void *state;             // Format private state
+} Cover;
+
+/*
+ * Operations every cover format provides.
+ * read/write move through the pixel stream in order, seek is only
+ * needed for decoding and may be slow when moving backwards.
+ */
+typedef struct _CoverFormat
+{
+    const char *name;
+    const char *suffix;
+    const char *stego_name;  // Default output file name
+    int in_place;            // Pixel bytes are stored as is, update can patch them
+
+    /* Parse the header and position at pixel byte 0 */
+    Status (*read_header)(Cover *cover);
+
+    /* Write a header for dest matching src */
+    Status (*write_header)(Cover *dest, Cover *src);
+
+    /* Read/write the next n pixel bytes */
+    long (*read)(Cover *cover, unsigned char *buf, long n);
+    Status (*write)(Cover *cover, const unsigned char *buf, long n);
+
+    /* Move to pixel byte 'offset' */
+    Status (*seek)(Cover *cover, long offset);
+
+    /* Write whatever follows the pixel stream (dest and src at its end) */
+    Status (*finish)(Cover *dest, Cover *src);
+
+    /* Free private state */
+    void (*release)(Cover *cover);
+} CoverFormat;
+
+/* Find the format for a file name by its suffix, NULL if unsupported */
+const CoverFormat *cover_format_for(const char *fname);
+
+/* Open a cover for reading: parse its header. geometry may be NULL if none was given */
+Status cover_open(Cover *cover, const CoverFormat *format, FILE *fptr, const CoverGeometry *geometry);
+
+/* Start a stego cover in fptr with the same format and header as src */
+Status cover_create(Cover *dest, Cover *src, FILE *fptr);
+
+/* Read n pixel bytes, returns the number read */
+long cover_read(Cover *cover, unsigned char *buf, long n);
+
+/* Write n pixel bytes */
+Status cover_write(Cover *cover, const unsigned char *buf, long n);
+
+/* Move to a pixel stream offset */
+Status cover_seek(Cover *cover, long offset);
+
+/* Copy n pixel bytes unchanged from src to dest */
+Status cover_copy(Cover *src, Cover *dest, long n);
+
+/* Copy the rest of the pixel stream and the trailer from src to dest */
+Status cover_finish(Cover *dest, Cover *src);
+
+/* Free private state of a cover */
+void cover_close(Cover *cover);
+
+/* Channel mask for letters like "gr", 0 if a letter is not in this format */
+uint cover_channel_mask(const Cover *cover, const char *letters);
+
+/*
+ * Helpers for formats whose pixels sit uncompressed at a fixed file
+ * offset. read_header fills in the geometry and calls plain_cover_init,
+ * the remaining operations can be used as they are.
+ */
+Status plain_cover_init(Cover *cover, long data_offset);
+Status plain_write_header(Cover *dest, Cover *src);
+long plain_read(Cover *cover, unsigned char *buf, long n);
+Status plain_write(Cover *cover, const unsigned char *buf, long n);
+Status plain_seek(Cover *cover, long offset);
+Status plain_finish(Cover *dest, Cover *src);
+void plain_release(Cover *cover);
+
+/* Supported formats */
+#define COVER_SUFFIXES ".bmp, .png, .ppm, .pgm, .tga or .raw"
+
+extern const CoverFormat bmp_format;
+extern const CoverFormat png_format;
+extern const CoverFormat ppm_format;
+extern const CoverFormat pgm_format;
+extern const CoverFormat tga_format;
+extern const CoverFormat raw_format;
+
+/* Parse and strip --raw=<w>x<h>x<bpp> from argv, returns new argc */
+int cover_parse_args(int argc, char *argv[], CoverGeometry *geometry);
+
+#endif
@@ -12,8 +12,12 @@ and the optional argument specifies the name of the output text file where the d
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "decode.h"
 #include "types.h"
+#include "profile.h"
 #define RED "\x1B[31m"
 #define GREEN "\x1B[32m"
 #define YELLOW "\x1B[33m"
@@ -21,22 +25,47 @@ and the optional argument specifies the name of the output text file where the d
 /* Read and validate decode arguments */
 Status read_and_validate_decode_args(char *argv[], DecodeInfo *decInfo)
 {
-    // Check if stego image has .bmp extension
-    int len = strlen(argv[2]);
-    if (len <= 4 || strcmp(argv[2] + len - 4, ".bmp") != 0)
+    decInfo->archive_action = e_archive_extract_all;
+    decInfo->fec_payload = NULL;
+    memset(&decInfo->adaptive, 0, sizeof(decInfo->adaptive));
+    memset(&decInfo->runs, 0, sizeof(decInfo->runs));
+    memset(&decInfo->archive, 0, sizeof(decInfo->archive));
+    decInfo->verify_only = 0;
+    decInfo->output_dir = NULL;
+    memset(&decInfo->raw_geometry, 0, sizeof(decInfo->raw_geometry));
+
+    // Check if stego image has a supported extension
+    decInfo->stego_format = cover_format_for(argv[2]);
+    if (decInfo->stego_format == NULL)
     {
-        printf(RED "ERROR: Stego image file must end with .bmp\n" RESET);
+        printf(RED "ERROR: Stego image file must end with " COVER_SUFFIXES "\n" RESET);
         return e_failure;
     }
 
     decInfo->stego_image_fname = argv[2];
 
+    if (argv[3] != NULL && strlen(argv[3]) > MAX_FNAME_SIZE)
+    {
+        printf(RED "ERROR: Output file name must be at most %d characters\n" RESET, MAX_FNAME_SIZE);
+        return e_failure;
+    }
+
+    // An existing directory as output takes the entries of an archive
+    struct stat st;
+    if (argv[3] != NULL && stat(argv[3], &st) == 0 && S_ISDIR(st.st_mode))
+        decInfo->output_dir = argv[3];
+
     // Handle optional output filename
     if (argv[3] != NULL)
     {
-        char temp_name[50];
+        char temp_name[MAX_FNAME_SIZE + 1];
         strcpy(temp_name, argv[3]);
         char *token = strtok(temp_name, ".");
+        if (token == NULL)
+        {
+            printf(RED "ERROR: Output file name has no base name\n" RESET);
+            return e_failure;
+        }
         strcpy(decInfo->secret_fname, token);  // base name only
     }
     else
@@ -47,10 +76,28 @@ Status read_and_validate_decode_args(char *argv[], DecodeInfo *decInfo)
     return e_success;
 }
 
+/* Read and validate -l <stego> / -x <stego> <entry> [output] arguments */
+Status read_and_validate_archive_args(char *argv[], ArchiveAction action, DecodeInfo *decInfo)
+{
+    char *stego_only[] = {argv[0], argv[1], argv[2], NULL};
+    if (read_and_validate_decode_args(stego_only, decInfo) != e_success)
+    {
+        return e_failure;
+    }
+
+    decInfo->archive_action = action;
+    if (action == e_archive_extract_one)
+    {
+        decInfo->entry_name = argv[3];
+        decInfo->entry_output = argv[4] != NULL ? argv[4] : argv[3];
+    }
+    return e_success;
+}
+
 /* Open stego image file for decoding */
 Status open_files_decode(DecodeInfo *decInfo)
 {
-    decInfo->fptr_stego_image = fopen(decInfo->stego_image_fname, "r");
+    decInfo->fptr_stego_image = fopen(decInfo->stego_image_fname, "rb");
     if (decInfo->fptr_stego_image == NULL)
     {
         perror("fopen");
@@ -61,6 +108,34 @@ Status open_files_decode(DecodeInfo *decInfo)
     return e_success;
 }
 
+/* Parse the cover header and find how many pixel bytes can carry data.
+ * Rejects anything that is not a supported, uncompressed pixel layout
+ * before a single payload bit is read.
+ */
+Status validate_stego_cover_header(DecodeInfo *decInfo)
+{
+    if (cover_open(&decInfo->stego_cover, decInfo->stego_format, decInfo->fptr_stego_image, &decInfo->raw_geometry) != e_success)
+    {
+        printf(RED "ERROR: Stego image is not a supported %s file.\n" RESET, decInfo->stego_format->name);
+        return e_failure;
+    }
+
+    decInfo->image_capacity = decInfo->stego_cover.pixel_bytes;
+    return e_success;
+}
+
+/* Check that the next 'bits' payload bits still fit in the pixel data */
+Status check_remaining_capacity(long bits, DecodeInfo *decInfo)
+{
+    long used = decInfo->stego_cover.pos;
+
+    if (bits < 0 || used < 0 || bits > decInfo->image_capacity - used)
+    {
+        return e_failure;
+    }
+    return e_success;
+}
+
 /* Decode 1 byte (8 bits) from 8 LSBs of image data */
 char decode_byte_from_lsb(char *image_buffer)
 {
@@ -72,40 +147,197 @@ char decode_byte_from_lsb(char *image_buffer)
     return data;
 }
 
-/* Decode 4 bytes (32 bits) integer from 32 LSBs */
-int decode_size_from_lsb(char *image_buffer)
+/* Decode 4 bytes (32 bits) unsigned integer from 32 LSBs */
+uint decode_uint_from_lsb(char *image_buffer)
 {
-    int size = 0;
+    uint value = 0;
     for (int i = 0; i < 32; i++)
     {
-        size = (size << 1) | (image_buffer[i] & 1);
+        value = (value << 1) | (image_buffer[i] & 1);
     }
-    return size;
+    return value;
 }
 
-/* Step 1: Verify Magic String */
+/* Decode 4 bytes (32 bits) integer from 32 LSBs
+ * Accumulated unsigned, a set top bit must not overflow a signed shift */
+int decode_size_from_lsb(char *image_buffer)
+{
+    return (int)decode_uint_from_lsb(image_buffer);
+}
+
+/* Step 1: Verify Magic String
+ * Each byte is compared as soon as it is decoded so an unrelated
+ * image is rejected after the first mismatching byte.
+ */
 Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo)
 {
     char image_buffer[8];
-    char decoded_magic[50];
-    int i;
+    int len = strlen(magic_string);
+
+    printf("Decoding magic string starting at offset %ld...\n", decInfo->stego_cover.pos);
+
+    if (check_remaining_capacity(len * 8, decInfo) != e_success)
+    {
+        printf(RED "ERROR: Image too small to hold a stego header.\n" RESET);
+        return e_failure;
+    }
+
+    for (int i = 0; i < len; i++)
+    {
+        if (cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, 8) != 8 ||
+            decode_byte_from_lsb(image_buffer) != magic_string[i])
+        {
+            printf(RED "ERROR: Magic string mismatch! Hidden data not found.\n" RESET);
+            return e_failure;
+        }
+    }
+
+    printf(GREEN "Magic string verified successfully: \"%s\"\n" RESET, magic_string);
+    return e_success;
+}
+
+/* Step 1b: Verify header format version */
+Status decode_stego_version(DecodeInfo *decInfo)
+{
+    char image_buffer[8];
+
+    if (check_remaining_capacity(8, decInfo) != e_success ||
+        cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, 8) != 8)
+    {
+        printf(RED "ERROR: Image too small to hold a stego header.\n" RESET);
+        return e_failure;
+    }
+
+    int version = (unsigned char)decode_byte_from_lsb(image_buffer);
+    if (version != STEGO_VERSION)
+    {
+        printf(RED "ERROR: Unsupported stego header version %d.\n" RESET, version);
+        return e_failure;
+    }
 
-    printf("Decoding magic string starting at offset 54...\n");
+    return e_success;
+}
+
+/* Step 1c: Decode header flags */
+Status decode_stego_flags(DecodeInfo *decInfo)
+{
+    char image_buffer[8];
 
-    for (i = 0; i < strlen(magic_string); i++)
+    if (check_remaining_capacity(8, decInfo) != e_success ||
+        cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, 8) != 8)
     {
-        fread(image_buffer, 1, 8, decInfo->fptr_stego_image);
-        decoded_magic[i] = decode_byte_from_lsb(image_buffer);
+        printf(RED "ERROR: Image too small to hold a stego header.\n" RESET);
+        return e_failure;
     }
-    decoded_magic[i] = '\0';
 
-    if (strcmp(decoded_magic, magic_string) != 0)
+    int flags = (unsigned char)decode_byte_from_lsb(image_buffer);
+    if (flags & ~(STEGO_FLAG_REGION | STEGO_FLAG_FEC | STEGO_FLAG_ARCHIVE | STEGO_FLAG_ADAPTIVE | STEGO_FLAG_DIGEST))
     {
-        printf(RED "ERROR: Magic string mismatch! Hidden data not found.\n" RESET);
+        printf(RED "ERROR: Unknown stego header flags 0x%02x.\n" RESET, flags);
         return e_failure;
     }
 
-    printf(GREEN "Magic string verified successfully: \"%s\"\n" RESET, decoded_magic);
+    memset(&decInfo->region, 0, sizeof(decInfo->region));
+    decInfo->region.enabled = (flags & STEGO_FLAG_REGION) != 0;
+    decInfo->region.channel_mask = (1u << decInfo->stego_cover.bpp) - 1;
+    decInfo->fec_parity = (flags & STEGO_FLAG_FEC) ? -1 : 0;   // read by decode_fec_params
+    decInfo->is_archive = (flags & STEGO_FLAG_ARCHIVE) != 0;
+    decInfo->adaptive.enabled = (flags & STEGO_FLAG_ADAPTIVE) != 0;
+    decInfo->has_digest = (flags & STEGO_FLAG_DIGEST) != 0;
+    if (decInfo->region.enabled && decInfo->adaptive.enabled)
+    {
+        printf(RED "ERROR: Stego header mixes region and adaptive layouts.\n" RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/* Step 1d: Decode channel/region layout */
+Status decode_embed_region(DecodeInfo *decInfo)
+{
+    char image_buffer[8 + 5 * 32];
+    EmbedRegion *region = &decInfo->region;
+
+    if (check_remaining_capacity(sizeof(image_buffer), decInfo) != e_success ||
+        cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, sizeof(image_buffer)) != sizeof(image_buffer))
+    {
+        printf(RED "ERROR: Image too small to hold a region header.\n" RESET);
+        return e_failure;
+    }
+
+    region->channel_mask = (unsigned char)decode_byte_from_lsb(image_buffer);
+    region->x = decode_size_from_lsb(image_buffer + 8);
+    region->y = decode_size_from_lsb(image_buffer + 40);
+    region->width = decode_size_from_lsb(image_buffer + 72);
+    region->height = decode_size_from_lsb(image_buffer + 104);
+    region->row_step = decode_size_from_lsb(image_buffer + 136);
+
+    // A zero size would mean "to the edge", never written by the encoder
+    if (region->width == 0 || region->height == 0 ||
+        validate_region(region, &decInfo->stego_cover) != e_success)
+    {
+        printf(RED "ERROR: Invalid region header.\n" RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/* Step 1e: Decode FEC parity count */
+Status decode_fec_params(DecodeInfo *decInfo)
+{
+    char image_buffer[8];
+
+    if (check_remaining_capacity(8, decInfo) != e_success ||
+        cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, 8) != 8)
+    {
+        printf(RED "ERROR: Image too small to hold a FEC header.\n" RESET);
+        return e_failure;
+    }
+
+    decInfo->fec_parity = (unsigned char)decode_byte_from_lsb(image_buffer);
+    if (fec_validate_parity(decInfo->fec_parity) != e_success)
+    {
+        printf(RED "ERROR: Invalid FEC header.\n" RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/* Step 1f: Decode adaptive cost threshold */
+Status decode_adaptive_params(DecodeInfo *decInfo)
+{
+    char image_buffer[8];
+
+    if (check_remaining_capacity(8, decInfo) != e_success ||
+        cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, 8) != 8)
+    {
+        printf(RED "ERROR: Image too small to hold an adaptive header.\n" RESET);
+        return e_failure;
+    }
+
+    decInfo->adaptive.threshold = (unsigned char)decode_byte_from_lsb(image_buffer);
+    if (decInfo->adaptive.threshold == 0)
+    {
+        printf(RED "ERROR: Invalid adaptive header.\n" RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/* Step 1g: Decode payload digest */
+Status decode_payload_digest(DecodeInfo *decInfo)
+{
+    char image_buffer[32];
+
+    decInfo->digest_offset = decInfo->stego_cover.pos;
+    if (check_remaining_capacity(32, decInfo) != e_success ||
+        cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, 32) != 32)
+    {
+        printf(RED "ERROR: Image too small to hold a payload digest.\n" RESET);
+        return e_failure;
+    }
+
+    decInfo->payload_digest = decode_uint_from_lsb(image_buffer);
     return e_success;
 }
 
@@ -113,12 +345,25 @@ Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo)
 Status decode_secret_file_extn_size(DecodeInfo *decInfo)
 {
     char buffer[32];
-    fread(buffer, 1, 32, decInfo->fptr_stego_image);
+    if (check_remaining_capacity(32, decInfo) != e_success ||
+        cover_read(&decInfo->stego_cover, (unsigned char *)buffer, 32) != 32)
+    {
+        printf(RED "ERROR: Image truncated before extension size.\n" RESET);
+        return e_failure;
+    }
 
     decInfo->extn_size = decode_size_from_lsb(buffer);
 
+    // Extension itself and the 32 bit file size must still fit
+    if (decInfo->extn_size < 2 || decInfo->extn_size > MAX_EXTN_SIZE ||
+        check_remaining_capacity(decInfo->extn_size * 8L + 32, decInfo) != e_success)
+    {
+        printf(RED "ERROR: Invalid secret file extension size %d.\n" RESET, decInfo->extn_size);
+        return e_failure;
+    }
+
     printf("Decoded secret file extension size: %d\n", decInfo->extn_size);
-    printf("Offset after decoding extension size: %ld\n", ftell(decInfo->fptr_stego_image));
+    printf("Offset after decoding extension size: %ld\n", decInfo->stego_cover.pos);
 
     return e_success;
 }
@@ -128,33 +373,35 @@ Status decode_secret_file_extn(DecodeInfo *decInfo)
 {
     char image_buffer[8];
     int size = decInfo->extn_size;
-    char decoded_extn[size + 1];
+    char decoded_extn[MAX_EXTN_SIZE + 1];
 
     printf("Decoding secret file extension of size %d...\n", size);
 
     for (int i = 0; i < size; i++)
     {
-        fread(image_buffer, 1, 8, decInfo->fptr_stego_image);
+        if (cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, 8) != 8)
+        {
+            printf(RED "ERROR: Image truncated inside extension.\n" RESET);
+            return e_failure;
+        }
         decoded_extn[i] = decode_byte_from_lsb(image_buffer);
+
+        // Extension must look like ".abc" so garbage never becomes a file name
+        if ((i == 0 && decoded_extn[i] != '.') || (i > 0 && !isalnum((unsigned char)decoded_extn[i])))
+        {
+            printf(RED "ERROR: Decoded extension is not valid.\n" RESET);
+            return e_failure;
+        }
     }
 
     decoded_extn[size] = '\0';
     strcpy(decInfo->extn_secret_file, decoded_extn);
 
     // Combine base filename and extension
-    sprintf(decInfo->secret_fname, "%s%s", decInfo->secret_fname, decoded_extn);
-
-    // Open output file for decoded data
-    decInfo->fptr_secret = fopen(decInfo->secret_fname, "w");
-    if (decInfo->fptr_secret == NULL)
-    {
-        printf(RED "ERROR: Unable to create output secret file.\n" RESET);
-        return e_failure;
-    }
+    strcat(decInfo->secret_fname, decoded_extn);
 
     printf(GREEN "Secret file extension decoded: %s\n" RESET, decoded_extn);
-    printf(GREEN "Created output file: %s\n" RESET, decInfo->secret_fname);
-    printf("Offset after decoding extension: %ld\n", ftell(decInfo->fptr_stego_image));
+    printf("Offset after decoding extension: %ld\n", decInfo->stego_cover.pos);
 
     return e_success;
 }
@@ -163,11 +410,47 @@ Status decode_secret_file_extn(DecodeInfo *decInfo)
 Status decode_secret_file_size(DecodeInfo *decInfo)
 {
     char buffer[32];
-    fread(buffer, 1, 32, decInfo->fptr_stego_image);
+    if (cover_read(&decInfo->stego_cover, (unsigned char *)buffer, 32) != 32)
+    {
+        printf(RED "ERROR: Image truncated before secret file size.\n" RESET);
+        return e_failure;
+    }
     decInfo->size_secret_file = decode_size_from_lsb(buffer);
+    decInfo->data_start = decInfo->stego_cover.pos;
+
+    // Reject sizes the remaining pixel data (or the region runs) cannot possibly hold
+    long payload_size = decInfo->size_secret_file;
+    if (decInfo->fec_parity != 0 && payload_size >= 0)
+        payload_size = fec_encoded_size(payload_size, decInfo->fec_parity);
+
+    Status fits;
+    if (decInfo->region.enabled)
+    {
+        fits = build_run_index(&decInfo->region, &decInfo->stego_cover, decInfo->stego_cover.pos,
+                               &decInfo->kernel, &decInfo->runs);
+        if (fits == e_success && payload_size > decInfo->runs.capacity)
+            fits = e_failure;
+    }
+    else if (decInfo->adaptive.enabled)
+    {
+        // Same cost map as the encoder: embedding never touched the upper 7 bits
+        fits = adaptive_load(&decInfo->adaptive, &decInfo->stego_cover, decInfo->stego_cover.pos);
+        if (fits == e_success && payload_size > adaptive_capacity(&decInfo->adaptive, decInfo->adaptive.threshold))
+            fits = e_failure;
+    }
+    else
+    {
+        fits = check_remaining_capacity(payload_size * 8, decInfo);
+    }
+
+    if (decInfo->size_secret_file < 0 || fits != e_success)
+    {
+        printf(RED "ERROR: Decoded secret file size %ld exceeds image capacity.\n" RESET, decInfo->size_secret_file);
+        return e_failure;
+    }
 
     printf("Decoded secret file size: %ld bytes\n", decInfo->size_secret_file);
-    printf("Offset after decoding file size: %ld\n", ftell(decInfo->fptr_stego_image));
+    printf("Offset after decoding file size: %ld\n", decInfo->stego_cover.pos);
 
     return e_success;
 }
@@ -185,18 +468,43 @@ Status decode_secret_file_data(DecodeInfo *decInfo)
         return e_failure;
     }
 
-    char image_buffer[8];
-    for (long i = 0; i < size; i++)
+    Status ret;
+    if (decInfo->fec_parity != 0)
+        ret = decode_fec_payload((unsigned char *)decoded_data, decInfo);
+    else if (decInfo->adaptive.enabled)
+        ret = decode_data_adaptive((unsigned char *)decoded_data, size, decInfo);
+    else if (decInfo->region.enabled)
+        ret = decode_data_from_runs((unsigned char *)decoded_data, size, decInfo);
+    else
+        ret = decode_data_flat((unsigned char *)decoded_data, size, decInfo);
+    if (ret != e_success)
     {
-        fread(image_buffer, 1, 8, decInfo->fptr_stego_image);
-        decoded_data[i] = decode_byte_from_lsb(image_buffer);
+        free(decoded_data);
+        return e_failure;
     }
 
     decoded_data[size] = '\0';
+
+    if (decInfo->has_digest && check_payload_digest((unsigned char *)decoded_data, size, decInfo) != e_success)
+    {
+        free(decoded_data);
+        return e_failure;
+    }
+
+    // Output file is only created once the whole payload was recovered
+    decInfo->fptr_secret = fopen(decInfo->secret_fname, "w");
+    if (decInfo->fptr_secret == NULL)
+    {
+        printf(RED "ERROR: Unable to create output secret file.\n" RESET);
+        free(decoded_data);
+        return e_failure;
+    }
+    printf(GREEN "Created output file: %s\n" RESET, decInfo->secret_fname);
+
     fwrite(decoded_data, 1, size, decInfo->fptr_secret);
 
     printf(GREEN "Decoded secret file data successfully.\n" RESET);
-    printf("Final offset after decoding: %ld\n", ftell(decInfo->fptr_stego_image));
+    printf("Final offset after decoding: %ld\n", decInfo->stego_cover.pos);
 
     fclose(decInfo->fptr_secret);
     free(decoded_data);
@@ -204,33 +512,471 @@ Status decode_secret_file_data(DecodeInfo *decInfo)
     return e_success;
 }
 
-/* Main decoding driver */
-Status do_decoding(DecodeInfo *decInfo)
+/* Compare the CRC-32 of the extracted secret data with the header digest */
+Status check_payload_digest(const unsigned char *data, long size, DecodeInfo *decInfo)
 {
-    if (open_files_decode(decInfo) != e_success)
+    uint digest = payload_digest(data, size);
+    if (digest != decInfo->payload_digest)
     {
-        fprintf(stderr, RED "Failed to open stego image file. Aborting decoding.\n" RESET);
+        printf(RED "ERROR: Payload digest mismatch: stored %08x, extracted data %08x.\n" RESET, decInfo->payload_digest, digest);
+        return e_failure;
+    }
+    printf(GREEN "Payload digest %08x verified.\n" RESET, digest);
+    return e_success;
+}
+
+/* Extract the whole payload only to check its digest, nothing is written */
+Status verify_payload_digest(DecodeInfo *decInfo)
+{
+    if (!decInfo->has_digest)
+    {
+        printf(RED "ERROR: %s holds no payload digest (encode with --verify).\n" RESET, decInfo->stego_image_fname);
         return e_failure;
     }
 
-    fseek(decInfo->fptr_stego_image, 54, SEEK_SET);
-    printf("Skipped BMP header. Current offset: %ld\n", ftell(decInfo->fptr_stego_image));
+    unsigned char *data = malloc(decInfo->size_secret_file + 1);
+    Status ret = data ? decode_payload_range(0, decInfo->size_secret_file, data, decInfo) : e_failure;
+    if (ret == e_success)
+        ret = check_payload_digest(data, decInfo->size_secret_file, decInfo);
+    else
+        printf(RED "ERROR: Unable to extract the payload.\n" RESET);
+
+    free(data);
+    free(decInfo->fec_payload);
+    decInfo->fec_payload = NULL;
+    free_run_index(&decInfo->runs);
+    return ret;
+}
 
-    if (decode_magic_string(MAGIC_STRING, decInfo) != e_success)
+/* Extract the RS coded payload and correct it into data (size_secret_file bytes) */
+Status decode_fec_payload(unsigned char *data, DecodeInfo *decInfo)
+{
+    long size = decInfo->size_secret_file;
+    long payload_size = fec_encoded_size(size, decInfo->fec_parity);
+
+    // Codewords are interleaved over the whole stream, so it is extracted whole
+    unsigned char *payload = malloc(payload_size);
+    if (!payload)
+    {
+        printf(RED "ERROR: Memory allocation failed for FEC data.\n" RESET);
         return e_failure;
+    }
+
+    Status ret = decInfo->adaptive.enabled ? decode_data_adaptive(payload, payload_size, decInfo)
+               : decInfo->region.enabled ? decode_data_from_runs(payload, payload_size, decInfo)
+               : decode_data_flat(payload, payload_size, decInfo);
+    if (ret == e_success)
+    {
+        long corrected;
+        ret = fec_decode(payload, size, decInfo->fec_parity, data, &corrected);
+        if (ret == e_success && corrected > 0)
+            printf(YELLOW "FEC corrected %ld damaged bytes.\n" RESET, corrected);
+    }
+    free(payload);
+    return ret;
+}
 
-    if (decode_secret_file_extn_size(decInfo) != e_success)
+/* Extract payload stored in every pixel byte after the header */
+Status decode_data_flat(unsigned char *data, long size, DecodeInfo *decInfo)
+{
+    // Extract in chunks through the kernel picked for this image
+    unsigned char *image_buffer = malloc(lsb_image_bytes_for(&decInfo->kernel, DATA_CHUNK_SIZE));
+    if (!image_buffer)
+    {
+        printf(RED "ERROR: Memory allocation failed for image buffer.\n" RESET);
         return e_failure;
+    }
+
+    for (long i = 0; i < size; i += DATA_CHUNK_SIZE)
+    {
+        long n = size - i > DATA_CHUNK_SIZE ? DATA_CHUNK_SIZE : size - i;
+        long image_bytes = lsb_image_bytes_for(&decInfo->kernel, n);
+
+        if (cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, image_bytes) != image_bytes)
+        {
+            printf(RED "ERROR: Image truncated inside secret data.\n" RESET);
+            free(image_buffer);
+            return e_failure;
+        }
+        lsb_extract(&decInfo->kernel, image_buffer, n, data + i);
+    }
+    free(image_buffer);
+    return e_success;
+}
+
+/* Extract payload from the region runs, seeking straight to each one */
+Status decode_data_from_runs(unsigned char *data, long size, DecodeInfo *decInfo)
+{
+    RunIndex *index = &decInfo->runs;
+    long done = 0;
 
-    if (decode_secret_file_extn(decInfo) != e_success)
+    unsigned char *image_buffer = malloc(index->max_length);
+    if (!image_buffer)
+    {
+        printf(RED "ERROR: Memory allocation failed for image buffer.\n" RESET);
         return e_failure;
+    }
 
-    if (decode_secret_file_size(decInfo) != e_success)
+    for (long r = 0; r < index->count && done < size; r++)
+    {
+        EmbedRun *run = &index->runs[r];
+        long n = run_payload_bytes(run, &decInfo->kernel);
+        if (n > size - done)
+            n = size - done;
+        long image_bytes = lsb_image_bytes_for(&decInfo->kernel, n);
+
+        if (cover_seek(&decInfo->stego_cover, run->offset) != e_success ||
+            cover_read(&decInfo->stego_cover, (unsigned char *)image_buffer, image_bytes) != image_bytes)
+        {
+            printf(RED "ERROR: Image truncated inside region run.\n" RESET);
+            free(image_buffer);
+            return e_failure;
+        }
+        lsb_extract(&decInfo->kernel, image_buffer, n, data + done);
+        done += n;
+    }
+
+    free(image_buffer);
+    free_run_index(index);
+    return done == size ? e_success : e_failure;
+}
+
+/* Extract payload from the adaptive carriers of the cost map */
+Status decode_data_adaptive(unsigned char *data, long size, DecodeInfo *decInfo)
+{
+    if (adaptive_extract(&decInfo->adaptive, 0, data, size) != e_success)
+    {
+        printf(RED "ERROR: Image truncated inside adaptive carriers.\n" RESET);
         return e_failure;
+    }
+    return e_success;
+}
+
+/* Extract n payload bytes, 'skip' bytes into the span whose first period starts at image offset 'offset' */
+static Status decode_span(long offset, long skip, long n, unsigned char *data, DecodeInfo *decInfo)
+{
+    const LsbKernel *kernel = &decInfo->kernel;
+    long chunk = DATA_CHUNK_SIZE - DATA_CHUNK_SIZE % kernel->period_bytes;
+    long pos = skip - skip % kernel->period_bytes;    // Whole periods only
+    long end = skip + n;
+
+    unsigned char *image_buffer = malloc(lsb_image_bytes_for(kernel, chunk));
+    unsigned char *bytes = malloc(chunk);
+    Status ret = image_buffer && bytes ? e_success : e_failure;
+
+    if (ret == e_success)
+        ret = cover_seek(&decInfo->stego_cover, offset + lsb_image_bytes_for(kernel, pos));
+    while (ret == e_success && n > 0)
+    {
+        long m = end - pos < chunk ? end - pos : chunk;
+        long image_bytes = lsb_image_bytes_for(kernel, m);
+        if (cover_read(&decInfo->stego_cover, image_buffer, image_bytes) != image_bytes)
+        {
+            ret = e_failure;
+            break;
+        }
+        lsb_extract(kernel, image_buffer, m, bytes);
+
+        long lead = skip > pos ? skip - pos : 0;
+        memcpy(data, bytes + lead, m - lead);
+        data += m - lead;
+        n -= m - lead;
+        pos += m;
+    }
+
+    if (ret != e_success)
+        printf(RED "ERROR: Image truncated inside secret data.\n" RESET);
+    free(image_buffer);
+    free(bytes);
+    return ret;
+}
 
-    if (decode_secret_file_data(decInfo) != e_success)
+/* Extract payload bytes [start, start + len) without reading the rest of the payload */
+Status decode_payload_range(long start, long len, unsigned char *data, DecodeInfo *decInfo)
+{
+    if (start < 0 || len < 0 || len > decInfo->size_secret_file - start)
         return e_failure;
 
-    printf(GREEN "Decoding completed successfully. Output file: %s\n" RESET, decInfo->secret_fname);
+    // FEC spreads every codeword over the whole payload, correct it once and keep it
+    if (decInfo->fec_parity != 0)
+    {
+        if (decInfo->fec_payload == NULL)
+        {
+            decInfo->fec_payload = malloc(decInfo->size_secret_file + 1);
+            if (!decInfo->fec_payload || decode_fec_payload(decInfo->fec_payload, decInfo) != e_success)
+                return e_failure;
+        }
+        memcpy(data, decInfo->fec_payload + start, len);
+        return e_success;
+    }
+
+    return decode_stored_range(start, len, data, decInfo);
+}
+
+/* Extract embedded bytes [start, start + len) as stored, without FEC correction */
+Status decode_stored_range(long start, long len, unsigned char *data, DecodeInfo *decInfo)
+{
+    if (decInfo->adaptive.enabled)
+        return adaptive_extract(&decInfo->adaptive, start, data, len);
+    if (!decInfo->region.enabled)
+        return decode_span(decInfo->data_start, start, len, data, decInfo);
+
+    // Skip whole runs up to the one holding 'start'
+    RunIndex *index = &decInfo->runs;
+    long base = 0;
+    for (long r = 0; r < index->count && len > 0; r++)
+    {
+        long capacity = run_payload_bytes(&index->runs[r], &decInfo->kernel);
+        if (start < base + capacity)
+        {
+            long n = base + capacity - start < len ? base + capacity - start : len;
+            if (decode_span(index->runs[r].offset, start - base, n, data, decInfo) != e_success)
+                return e_failure;
+            data += n;
+            start += n;
+            len -= n;
+        }
+        base += capacity;
+    }
+    return len == 0 ? e_success : e_failure;
+}
+
+/* Extract one archive entry, the file is only written if its checksum matches */
+Status decode_archive_entry(const ArchiveEntry *entry, const char *fname, DecodeInfo *decInfo)
+{
+    unsigned char *data = malloc(entry->size + 1);
+    if (!data)
+    {
+        printf(RED "ERROR: Memory allocation failed for %s.\n" RESET, entry->name);
+        return e_failure;
+    }
+
+    if (decode_payload_range(entry->offset, entry->size, data, decInfo) != e_success)
+    {
+        free(data);
+        return e_failure;
+    }
+    if (archive_checksum(data, entry->size) != entry->crc)
+    {
+        printf(RED "ERROR: Checksum mismatch for %s, not extracted.\n" RESET, entry->name);
+        free(data);
+        return e_failure;
+    }
+
+    // Never replace a file that is already there
+    FILE *fptr = fopen(fname, "wbx");
+    if (fptr == NULL && errno == EEXIST)
+    {
+        printf(RED "ERROR: %s already exists, not overwritten.\n" RESET, fname);
+        free(data);
+        return e_failure;
+    }
+    if (fptr == NULL || fwrite(data, 1, entry->size, fptr) != (size_t)entry->size)
+    {
+        printf(RED "ERROR: Unable to write %s.\n" RESET, fname);
+        if (fptr)
+            fclose(fptr);
+        free(data);
+        return e_failure;
+    }
+    fclose(fptr);
+    free(data);
+
+    printf(GREEN "Extracted %s (%ld bytes)\n" RESET, fname, entry->size);
     return e_success;
 }
+
+/* Step 5 (archive): read the index, then list or extract entries */
+Status decode_archive(DecodeInfo *decInfo)
+{
+    ArchiveIndex *index = &decInfo->archive;
+    unsigned char prefix[ARCHIVE_PREFIX_BYTES];
+    Status ret;
+
+    if (decInfo->size_secret_file < ARCHIVE_PREFIX_BYTES ||
+        decode_payload_range(0, ARCHIVE_PREFIX_BYTES, prefix, decInfo) != e_success ||
+        archive_read_prefix(prefix, decInfo->size_secret_file, index) != e_success)
+    {
+        printf(RED "ERROR: Unable to read archive index.\n" RESET);
+        return e_failure;
+    }
+
+    unsigned char *table = malloc(index->table_bytes + 1);
+    if (!table)
+    {
+        printf(RED "ERROR: Memory allocation failed for archive index.\n" RESET);
+        return e_failure;
+    }
+    ret = decode_payload_range(ARCHIVE_PREFIX_BYTES, index->table_bytes, table, decInfo);
+    if (ret == e_success)
+        ret = archive_parse_table(table, decInfo->size_secret_file, index);
+    free(table);
+    if (ret != e_success)
+        return e_failure;
+
+    printf("Archive holds %ld entries\n", index->count);
+    switch (decInfo->archive_action)
+    {
+        case e_archive_list:
+            for (long i = 0; i < index->count; i++)
+                printf("%10ld  %08x  %s\n", index->entries[i].size, index->entries[i].crc, index->entries[i].name);
+            break;
+
+        case e_archive_extract_one:
+        {
+            const ArchiveEntry *entry = archive_find(index, decInfo->entry_name);
+            if (entry == NULL)
+            {
+                printf(RED "ERROR: No entry named %s in the archive.\n" RESET, decInfo->entry_name);
+                ret = e_failure;
+            }
+            else
+            {
+                ret = decode_archive_entry(entry, decInfo->entry_output, decInfo);
+            }
+            break;
+        }
+
+        default:
+            // Entries go into the output directory or get the output base name as prefix.
+            // A damaged entry does not stop the intact ones from being extracted
+            for (long i = 0; i < index->count; i++)
+            {
+                char fname[MAX_FNAME_SIZE + MAX_ENTRY_NAME + 2];
+                if (decInfo->output_dir)
+                    snprintf(fname, sizeof(fname), "%s/%s", decInfo->output_dir, index->entries[i].name);
+                else
+                    snprintf(fname, sizeof(fname), "%.*s_%s", (int)(strlen(decInfo->secret_fname) - decInfo->extn_size),
+                             decInfo->secret_fname, index->entries[i].name);
+                if (decode_archive_entry(&index->entries[i], fname, decInfo) != e_success)
+                    ret = e_failure;
+            }
+            break;
+    }
+
+    free_archive_index(index);
+    free_run_index(&decInfo->runs);
+    free(decInfo->fec_payload);
+    decInfo->fec_payload = NULL;
+    return ret;
+}
+
+/* Parse the cover and the stego header up to the secret file size.
+ * Leaves the stream at payload byte 0 (decInfo->data_start).
+ */
+Status decode_stego_header(DecodeInfo *decInfo)
+{
+    Status ret;
+
+    profile_begin("validate_stego_cover_header", NULL);
+    ret = validate_stego_cover_header(decInfo);
+    profile_end(NULL);
+    if (ret != e_success)
+        return e_failure;
+
+    printf("Skipped %s header. Current offset: %ld\n", decInfo->stego_format->name, decInfo->stego_cover.pos);
+
+    profile_begin("decode_magic_string", &decInfo->stego_cover.pos);
+    ret = decode_magic_string(MAGIC_STRING, decInfo);
+    profile_end(&decInfo->stego_cover.pos);
+    if (ret != e_success)
+        return e_failure;
+
+    profile_begin("decode_stego_version", &decInfo->stego_cover.pos);
+    ret = decode_stego_version(decInfo);
+    profile_end(&decInfo->stego_cover.pos);
+    if (ret != e_success)
+        return e_failure;
+
+    profile_begin("decode_stego_flags", &decInfo->stego_cover.pos);
+    ret = decode_stego_flags(decInfo);
+    if (ret == e_success && decInfo->region.enabled)
+        ret = decode_embed_region(decInfo);
+    if (ret == e_success && decInfo->fec_parity != 0)
+        ret = decode_fec_params(decInfo);
+    if (ret == e_success && decInfo->adaptive.enabled)
+        ret = decode_adaptive_params(decInfo);
+    if (ret == e_success && decInfo->has_digest)
+        ret = decode_payload_digest(decInfo);
+    profile_end(&decInfo->stego_cover.pos);
+    if (ret != e_success)
+        return e_failure;
+
+    // Pick the extract kernel once for the whole image
+    if (lsb_select_kernel(DEFAULT_LSB_BITS, decInfo->stego_cover.bpp, decInfo->region.channel_mask, &decInfo->kernel) != e_success)
+        return e_failure;
+
+    profile_begin("decode_secret_file_extn_size", &decInfo->stego_cover.pos);
+    ret = decode_secret_file_extn_size(decInfo);
+    profile_end(&decInfo->stego_cover.pos);
+    if (ret != e_success)
+        return e_failure;
+
+    profile_begin("decode_secret_file_extn", &decInfo->stego_cover.pos);
+    ret = decode_secret_file_extn(decInfo);
+    profile_end(&decInfo->stego_cover.pos);
+    if (ret != e_success)
+        return e_failure;
+
+    profile_begin("decode_secret_file_size", &decInfo->stego_cover.pos);
+    ret = decode_secret_file_size(decInfo);
+    profile_end(&decInfo->stego_cover.pos);
+    if (ret != e_success)
+        return e_failure;
+
+    return e_success;
+}
+
+/* Main decoding driver */
+Status do_decoding(DecodeInfo *decInfo)
+{
+    Status ret;
+
+    profile_begin("open_files_decode", NULL);
+    ret = open_files_decode(decInfo);
+    profile_end(NULL);
+    if (ret != e_success)
+    {
+        fprintf(stderr, RED "Failed to open stego image file. Aborting decoding.\n" RESET);
+        return e_failure;
+    }
+
+    ret = decode_stego_header(decInfo);
+
+    if (ret == e_success && decInfo->verify_only)
+    {
+        // Check only, for any payload type
+        profile_begin("verify_payload_digest", NULL);
+        ret = verify_payload_digest(decInfo);
+        profile_end(NULL);
+    }
+    else if (ret == e_success && decInfo->is_archive)
+    {
+        profile_begin("decode_archive", &decInfo->stego_cover.pos);
+        ret = decode_archive(decInfo);
+        profile_end(&decInfo->stego_cover.pos);
+    }
+    else if (ret == e_success && decInfo->archive_action != e_archive_extract_all)
+    {
+        printf(RED "ERROR: Stego image does not hold an archive.\n" RESET);
+        ret = e_failure;
+    }
+    else if (ret == e_success)
+    {
+        profile_begin("decode_secret_file_data", &decInfo->stego_cover.pos);
+        ret = decode_secret_file_data(decInfo);
+        profile_end(&decInfo->stego_cover.pos);
+        if (ret == e_success)
+            printf(GREEN "Decoding completed successfully. Output file: %s\n" RESET, decInfo->secret_fname);
+    }
+
+    // Every exit after the image was opened releases the same state
+    free(decInfo->fec_payload);
+    decInfo->fec_payload = NULL;
+    free_run_index(&decInfo->runs);
+    free_archive_index(&decInfo->archive);
+    free_adaptive_map(&decInfo->adaptive);
+    cover_close(&decInfo->stego_cover);
+    fclose(decInfo->fptr_stego_image);
+    return ret;
+}
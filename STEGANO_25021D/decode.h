@@ -4,40 +4,100 @@
 #include <stdio.h>
 #include <string.h>
 #include "types.h"
-
-#define MAGIC_STRING "#*"   // Must match encoding part
+#include "common.h"   // Header layout, must match encoding part
+#include "lsb.h"      // Extract kernels
+#include "region.h"   // Channel/region runs
+#include "cover.h"    // Cover image formats
+#include "fec.h"      // Payload error correction
+#include "archive.h"  // Multi-file payloads
+#include "adaptive.h" // Texture-driven carriers
+#include "verify.h"   // Payload digest
 
 typedef struct _DecodeInfo
 {
     /* Stego Image Info */
     char *stego_image_fname;
     FILE *fptr_stego_image;
+    const CoverFormat *stego_format;
+    CoverGeometry raw_geometry;  // --raw geometry of a .raw stego image
+    Cover stego_cover;           // Parsed stego image, read as a pixel stream
+    long image_capacity;         // Pixel bytes in the stream
 
     /* Output (decoded) Secret File Info */
-    char secret_fname[20];
+    char secret_fname[MAX_FNAME_SIZE + MAX_EXTN_SIZE + 1];
     FILE *fptr_secret;
 
     /* Extracted Extension Info */
-    char extn_secret_file[8];
+    char extn_secret_file[MAX_EXTN_SIZE + 1];
     int extn_size;               // ✅ newly added field to store decoded extension size
 
     /* Secret File Size Info */
     long size_secret_file;
 
+    /* Extract kernel chosen for this image */
+    LsbKernel kernel;
+
+    /* Channel/region layout read from the header */
+    EmbedRegion region;
+    RunIndex runs;
+
+    /* RS parity bytes per codeword, 0 = no FEC */
+    int fec_parity;
+    unsigned char *fec_payload;  // Corrected payload, random access reads it
+
+    /* Adaptive carriers, rebuilt from the stego pixels */
+    AdaptiveMap adaptive;
+
+    /* CRC-32 of the secret data, checked once it is extracted */
+    int has_digest;
+    uint payload_digest;
+    long digest_offset;          // Pixel stream offset of the digest field
+    int verify_only;             // Check the digest, write no output
+
+    /* Multi-file payload */
+    int is_archive;
+    ArchiveAction archive_action;
+    const char *entry_name;      // Entry for e_archive_extract_one
+    const char *entry_output;    // File it is written to
+    const char *output_dir;      // Output name is a directory, extract-all writes into it
+    ArchiveIndex archive;
+    long data_start;             // Pixel stream offset of payload byte 0
+
 } DecodeInfo;
 
 /* Function Prototypes */
 Status read_and_validate_decode_args(char *argv[], DecodeInfo *decInfo);
+Status read_and_validate_archive_args(char *argv[], ArchiveAction action, DecodeInfo *decInfo);
 Status open_files_decode(DecodeInfo *decInfo);
+Status validate_stego_cover_header(DecodeInfo *decInfo);
+Status check_remaining_capacity(long bits, DecodeInfo *decInfo);
 Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo);
+Status decode_stego_version(DecodeInfo *decInfo);
+Status decode_stego_flags(DecodeInfo *decInfo);
+Status decode_embed_region(DecodeInfo *decInfo);
+Status decode_fec_params(DecodeInfo *decInfo);
+Status decode_adaptive_params(DecodeInfo *decInfo);
+Status decode_payload_digest(DecodeInfo *decInfo);
 Status decode_secret_file_extn_size(DecodeInfo *decInfo);
 Status decode_secret_file_extn(DecodeInfo *decInfo);
 Status decode_secret_file_size(DecodeInfo *decInfo);
 Status decode_secret_file_data(DecodeInfo *decInfo);
+Status decode_fec_payload(unsigned char *data, DecodeInfo *decInfo);
+Status decode_data_flat(unsigned char *data, long size, DecodeInfo *decInfo);
+Status decode_data_from_runs(unsigned char *data, long size, DecodeInfo *decInfo);
+Status decode_data_adaptive(unsigned char *data, long size, DecodeInfo *decInfo);
+Status decode_payload_range(long start, long len, unsigned char *data, DecodeInfo *decInfo);
+Status decode_stored_range(long start, long len, unsigned char *data, DecodeInfo *decInfo);
+Status decode_archive(DecodeInfo *decInfo);
+Status decode_archive_entry(const ArchiveEntry *entry, const char *fname, DecodeInfo *decInfo);
+Status check_payload_digest(const unsigned char *data, long size, DecodeInfo *decInfo);
+Status verify_payload_digest(DecodeInfo *decInfo);
+Status decode_stego_header(DecodeInfo *decInfo);
 Status do_decoding(DecodeInfo *decInfo);
 
-/* Helper Functions */
+/* Helper Functions (reference bit loops, faster kernels must match them) */
 char decode_byte_from_lsb(char *image_buffer);
+uint decode_uint_from_lsb(char *image_buffer);
 int decode_size_from_lsb(char *image_buffer);
 
 #endif
@@ -9,37 +9,15 @@ file and the fourth argument can be the output file which will contain the desti
 #include <string.h>
 #include <stdlib.h>
 #include "encode.h"
+#include "decode.h"
 #include "types.h"
+#include "profile.h"
 #define RED     "\033[1;31m"
 #define GREEN   "\033[1;32m"
 #define RESET   "\033[0m"
 
 /* Function Definitions */
 
-/* Get image size
- * Input: Image file ptr
- * Output: width * height * bytes per pixel (3 in our case)
- * Description: In BMP Image, width is stored in offset 18,
- * and height after that. size is 4 bytes
- */
-uint get_image_size_for_bmp(FILE *fptr_image)
-{
-    uint width, height;
-    // Seek to 18th byte
-    fseek(fptr_image, 18, SEEK_SET);
-
-    // Read the width (an int)
-    fread(&width, sizeof(int), 1, fptr_image);
-    printf("width = %u\n", width);
-
-    // Read the height (an int)
-    fread(&height, sizeof(int), 1, fptr_image);
-    printf("height = %u\n", height);
-
-    // Return image capacity
-    return width * height * 3;
-}
-
 uint get_file_size(FILE *fptr)
 {
     // Find the size of secret file data
@@ -57,19 +35,49 @@ uint get_file_size(FILE *fptr)
 
 Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
 {
-    int len_src = strlen(argv[2]);
-    if (len_src > 4 && strcmp(argv[2] + len_src - 4, ".bmp") == 0)
+    encInfo->src_format = cover_format_for(argv[2]);
+    if (encInfo->src_format != NULL)
     {
         encInfo->src_image_fname = argv[2];
     }
     else
     {
-        fprintf(stderr, RED"ERROR: Source file must end with .bmp\n"RESET);
+        fprintf(stderr, RED"ERROR: Source file must end with " COVER_SUFFIXES "\n"RESET);
+        return e_failure;
+    }
+
+    // Trailing image name is the output, two or more secret files make an archive
+    int count = 0;
+    while (argv[3 + count] != NULL)
+    {
+        count++;
+    }
+    char *output = NULL;
+    if (count > 1 && cover_format_for(argv[2 + count]) != NULL)
+    {
+        output = argv[2 + count];
+        count--;
+    }
+
+    encInfo->archive_count = 0;
+    if (count > 1)
+    {
+        encInfo->archive_files = argv + 3;
+        encInfo->archive_count = count;
+        encInfo->secret_fname = ARCHIVE_NAME;
+    }
+    else if (count != 1)
+    {
+        fprintf(stderr, RED"ERROR: No secret file given\n"RESET);
         return e_failure;
     }
 
     int len_secret = strlen(argv[3]);
-    if (len_secret > 4 && strcmp(argv[3] + len_secret - 4, ".txt") == 0)//checks if extension is txt
+    if (encInfo->archive_count > 0)
+    {
+        printf("Building an archive of %d files\n", encInfo->archive_count);
+    }
+    else if (len_secret > 4 && strcmp(argv[3] + len_secret - 4, ".txt") == 0)//checks if extension is txt
     {
         encInfo->secret_fname = argv[3];
         strcpy(encInfo->extn_secret_file, ".txt");
@@ -100,22 +108,22 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
         return e_failure;
     }
 
-    if (argv[4] != NULL)
+    if (output != NULL)
     {
-        int len_out = strlen(argv[4]);
-        if (len_out > 4 && strcmp(argv[4] + len_out - 4, ".bmp") == 0)
+        // Stego image is written in the same format as the source
+        if (cover_format_for(output) == encInfo->src_format)
         {
-            encInfo->stego_image_fname = argv[4];
+            encInfo->stego_image_fname = output;
         }
         else
         {
-            fprintf(stderr, RED"ERROR: Output file must end with .bmp\n"RESET);
+            fprintf(stderr, RED"ERROR: Output file must end with %s\n"RESET, encInfo->src_format->suffix);
             return e_failure;
         }
     }
     else
     {
-        encInfo->stego_image_fname = "stego.bmp";
+        encInfo->stego_image_fname = (char *)encInfo->src_format->stego_name;
     }
 
     return e_success;
@@ -124,7 +132,7 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo)
 Status open_files(EncodeInfo *encInfo)
 {
     // Src Image file
-    encInfo->fptr_src_image = fopen(encInfo->src_image_fname, "r");
+    encInfo->fptr_src_image = fopen(encInfo->src_image_fname, "rb");
     if (encInfo->fptr_src_image == NULL)
     {
         perror("fopen");
@@ -133,16 +141,13 @@ Status open_files(EncodeInfo *encInfo)
     }
 
     // Secret file
-    encInfo->fptr_secret = fopen(encInfo->secret_fname, "r");
-    if (encInfo->fptr_secret == NULL)
+    if (open_secret_file(encInfo) != e_success)
     {
-        perror("fopen");
-        fprintf(stderr, RED"ERROR: Unable to open file %s\n"RESET, encInfo->secret_fname);
         return e_failure;
     }
 
     // Stego Image file
-    encInfo->fptr_stego_image = fopen(encInfo->stego_image_fname, "w");
+    encInfo->fptr_stego_image = fopen(encInfo->stego_image_fname, "wb");
     if (encInfo->fptr_stego_image == NULL)
     {
         perror("fopen");
@@ -153,31 +158,154 @@ Status open_files(EncodeInfo *encInfo)
     return e_success;
 }
 
+Status open_secret_file(EncodeInfo *encInfo)
+{
+    // Secret file, or the archive payload built from all secret files
+    if (encInfo->archive_count > 0)
+    {
+        encInfo->fptr_secret = tmpfile();
+        if (encInfo->fptr_secret == NULL ||
+            archive_write(encInfo->archive_files, encInfo->archive_count, encInfo->fptr_secret) != e_success)
+        {
+            return e_failure;
+        }
+    }
+    else
+    {
+        encInfo->fptr_secret = fopen(encInfo->secret_fname, "r");
+    }
+    if (encInfo->fptr_secret == NULL)
+    {
+        perror("fopen");
+        fprintf(stderr, RED"ERROR: Unable to open file %s\n"RESET, encInfo->secret_fname);
+        return e_failure;
+    }
+    return e_success;
+}
+
 Status check_capacity(EncodeInfo *encInfo)
 {
-    encInfo->image_capacity = get_image_size_for_bmp(encInfo->fptr_src_image);
+    Cover *cover = &encInfo->src_cover;
+
+    if (cover_open(cover, encInfo->src_format, encInfo->fptr_src_image, &encInfo->raw_geometry) != e_success)
+    {
+        fprintf(stderr, RED"ERROR: %s is not a supported %s image\n"RESET, encInfo->src_image_fname, encInfo->src_format->name);
+        return e_failure;
+    }
+    printf("width = %u\n", cover->width);
+    printf("height = %u\n", cover->height);
+
+    encInfo->image_capacity = cover->pixel_bytes;
     encInfo->size_secret_file = get_file_size(encInfo->fptr_secret);
 
-    if ((encInfo->image_capacity > (strlen(MAGIC_STRING) * 8) + 32 + (strlen(encInfo->extn_secret_file) * 8) + 32 + (encInfo->size_secret_file * 8)))
+    // With FEC the parity bytes are embedded along with the data
+    long payload_size = encInfo->size_secret_file;
+    if (encInfo->fec_parity != 0)
+    {
+        if (fec_validate_parity(encInfo->fec_parity) != e_success)
+        {
+            return e_failure;
+        }
+        payload_size = fec_encoded_size(encInfo->size_secret_file, encInfo->fec_parity);
+        printf("FEC payload: %ld bytes (%d parity bytes per codeword)\n", payload_size, encInfo->fec_parity);
+    }
+
+    // Pick the embed kernel once for the whole image
+    uint channel_mask = (1u << cover->bpp) - 1;
+    if (encInfo->region.enabled)
+    {
+        encInfo->region.channel_mask = cover_channel_mask(cover, encInfo->region.channels);
+        if (validate_region(&encInfo->region, cover) != e_success)
+        {
+            return e_failure;
+        }
+        channel_mask = encInfo->region.channel_mask;
+    }
+    if (lsb_select_kernel(DEFAULT_LSB_BITS, cover->bpp, channel_mask, &encInfo->kernel) != e_success)
+    {
+        printf(RED"ERROR: No embed kernel for this image layout.\n"RESET);
+        return e_failure;
+    }
+
+    if (encInfo->adaptive.enabled)
+    {
+        if (encInfo->region.enabled)
+        {
+            printf(RED"ERROR: --adaptive picks its own carriers, it cannot be combined with --channels/--region/--row-step.\n"RESET);
+            return e_failure;
+        }
+        if (adaptive_load(&encInfo->adaptive, cover, stego_header_image_bytes(encInfo)) != e_success)
+        {
+            return e_failure;
+        }
+
+        // Use only the most textured bytes that still hold the payload
+        encInfo->adaptive.threshold = adaptive_select_threshold(&encInfo->adaptive, payload_size);
+        printf("Adaptive capacity: %ld bytes, cost threshold %d\n", adaptive_capacity(&encInfo->adaptive, 1), encInfo->adaptive.threshold);
+        if (encInfo->adaptive.threshold > 0)
+        {
+            return e_success;
+        }
+        return e_failure;
+    }
+
+    if (encInfo->region.enabled)
+    {
+        if (build_run_index(&encInfo->region, cover, stego_header_image_bytes(encInfo),
+                            &encInfo->kernel, &encInfo->runs) != e_success)
+        {
+            return e_failure;
+        }
+
+        printf("Region capacity: %ld bytes in %ld runs\n", encInfo->runs.capacity, encInfo->runs.count);
+        if (payload_size <= encInfo->runs.capacity)
+        {
+            return e_success;
+        }
+        return e_failure;
+    }
+
+    if (encInfo->image_capacity > stego_header_image_bytes(encInfo) + (payload_size * 8))
     {
         return e_success;
     }
     return e_failure;
 }
 
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image)
+long stego_header_image_bytes(EncodeInfo *encInfo)
 {
-    unsigned char header[54];
-    int src_pos;
-    int dest_pos;
-    rewind(fptr_src_image);
-    fread(header, 1, 54, fptr_src_image);
-    fwrite(header, 1, 54, fptr_dest_image);
-    src_pos = ftell(fptr_src_image);
-    dest_pos = ftell(fptr_dest_image);
-    if (src_pos == dest_pos && src_pos == 54)
-    {
-          printf("Offset validation passed: src = %d, dest = %d\n", src_pos, dest_pos);
+    // magic + version + flags [+ region] [+ fec] [+ threshold] [+ digest] + extn size + extn + file size
+    long bits = (strlen(MAGIC_STRING) * 8) + 8 + 8 + 32 + (strlen(encInfo->extn_secret_file) * 8) + 32;
+    if (encInfo->region.enabled)
+    {
+        bits += 8 + 5 * 32;
+    }
+    if (encInfo->fec_parity != 0)
+    {
+        bits += 8;
+    }
+    if (encInfo->adaptive.enabled)
+    {
+        bits += 8;
+    }
+    if (encInfo->verify)
+    {
+        bits += 32;
+    }
+    return bits;
+}
+
+Status copy_cover_header(EncodeInfo *encInfo)
+{
+    if (cover_create(&encInfo->stego_cover, &encInfo->src_cover, encInfo->fptr_stego_image) != e_success)
+    {
+        return e_failure;
+    }
+    long src_pos = encInfo->src_cover.pos;
+    long dest_pos = encInfo->stego_cover.pos;
+    if (src_pos == dest_pos && src_pos == 0)
+    {
+        printf("Offset validation passed: src = %ld, dest = %ld\n", src_pos, dest_pos);
         return e_success;
     }
     else
@@ -189,40 +317,180 @@ Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image)
 Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo)
 {
     char image_buffer[8];
-    int src, dest;
-    for (int i = 0; i < 2; i++)
+    long src, dest;
+    int len = strlen(magic_string);
+    for (int i = 0; i < len; i++)
     {
-        fread(image_buffer, 1, 8, encInfo->fptr_src_image);
-        if (encInfo->fptr_src_image == NULL)
+        if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, 8) != 8)
         {
             return e_failure;
         }
         encode_byte_to_lsb(magic_string[i], image_buffer);
-        fwrite(image_buffer, 1, 8, encInfo->fptr_stego_image);
+        if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, 8) != e_success)
+        {
+            return e_failure;
+        }
     }
-    src = ftell(encInfo->fptr_src_image);
-    dest = ftell(encInfo->fptr_stego_image);
-    if ((src && dest) == 70)
+    src = encInfo->src_cover.pos;
+    dest = encInfo->stego_cover.pos;
+    if (src == dest && src == len * 8)
     {
-        printf("Offset validation passed: src = %d, dest = %d\n", src, dest);
+        printf("Offset validation passed: src = %ld, dest = %ld\n", src, dest);
         return e_success;
     }
     return e_failure;
 }
 
+Status encode_stego_version(EncodeInfo *encInfo)
+{
+    char image_buffer[8];
+    if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, 8) != 8)
+    {
+        printf(RED"ERROR: Unable to read 8 bytes from source image.\n"RESET);
+        return e_failure;
+    }
+    encode_byte_to_lsb(STEGO_VERSION, image_buffer);
+    if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, 8) != e_success)
+    {
+        printf(RED"ERROR: Unable to write header version to stego image.\n"RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status encode_stego_flags(EncodeInfo *encInfo)
+{
+    char image_buffer[8];
+    char flags = 0;
+    if (encInfo->region.enabled)
+    {
+        flags |= STEGO_FLAG_REGION;
+    }
+    if (encInfo->fec_parity != 0)
+    {
+        flags |= STEGO_FLAG_FEC;
+    }
+    if (encInfo->archive_count > 0)
+    {
+        flags |= STEGO_FLAG_ARCHIVE;
+    }
+    if (encInfo->adaptive.enabled)
+    {
+        flags |= STEGO_FLAG_ADAPTIVE;
+    }
+    if (encInfo->verify)
+    {
+        flags |= STEGO_FLAG_DIGEST;
+    }
+
+    if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, 8) != 8)
+    {
+        printf(RED"ERROR: Unable to read 8 bytes from source image.\n"RESET);
+        return e_failure;
+    }
+    encode_byte_to_lsb(flags, image_buffer);
+    if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, 8) != e_success)
+    {
+        printf(RED"ERROR: Unable to write header flags to stego image.\n"RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status encode_embed_region(EncodeInfo *encInfo)
+{
+    char image_buffer[8 + 5 * 32];
+    EmbedRegion *region = &encInfo->region;
+    uint fields[5] = {region->x, region->y, region->width, region->height, region->row_step};
+
+    if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, sizeof(image_buffer)) != sizeof(image_buffer))
+    {
+        printf(RED"ERROR: Unable to read region header bytes from source image.\n"RESET);
+        return e_failure;
+    }
+    encode_byte_to_lsb(region->channel_mask, image_buffer);
+    for (int i = 0; i < 5; i++)
+    {
+        encode_size_to_lsb(fields[i], image_buffer + 8 + i * 32);
+    }
+    if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, sizeof(image_buffer)) != e_success)
+    {
+        printf(RED"ERROR: Unable to write region header to stego image.\n"RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status encode_fec_params(EncodeInfo *encInfo)
+{
+    char image_buffer[8];
+    if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, 8) != 8)
+    {
+        printf(RED"ERROR: Unable to read 8 bytes from source image.\n"RESET);
+        return e_failure;
+    }
+    encode_byte_to_lsb(encInfo->fec_parity, image_buffer);
+    if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, 8) != e_success)
+    {
+        printf(RED"ERROR: Unable to write FEC header to stego image.\n"RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status encode_adaptive_params(EncodeInfo *encInfo)
+{
+    char image_buffer[8];
+    if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, 8) != 8)
+    {
+        printf(RED"ERROR: Unable to read 8 bytes from source image.\n"RESET);
+        return e_failure;
+    }
+    encode_byte_to_lsb(encInfo->adaptive.threshold, image_buffer);
+    if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, 8) != e_success)
+    {
+        printf(RED"ERROR: Unable to write adaptive header to stego image.\n"RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+Status encode_payload_digest(EncodeInfo *encInfo)
+{
+    char image_buffer[32];
+    if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, 32) != 32)
+    {
+        printf(RED"ERROR: Unable to read 32 bytes from source image.\n"RESET);
+        return e_failure;
+    }
+    encode_uint_to_lsb(encInfo->payload_digest, image_buffer);
+    if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, 32) != e_success)
+    {
+        printf(RED"ERROR: Unable to write payload digest to stego image.\n"RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
 Status encode_secret_file_extn_size(int size, EncodeInfo *encInfo)
 {
     char image_buffer[32];
-    int srcoff;
-    int destoff;
-    fread(image_buffer, 1, 32, encInfo->fptr_src_image);
+    long srcoff;
+    long destoff;
+    if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, 32) != 32)
+    {
+        return e_failure;
+    }
     encode_size_to_lsb(size, image_buffer);
-    fwrite(image_buffer, 1, 32, encInfo->fptr_stego_image);
-    srcoff = ftell(encInfo->fptr_src_image);
-    destoff = ftell(encInfo->fptr_stego_image);
+    if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, 32) != e_success)
+    {
+        return e_failure;
+    }
+    srcoff = encInfo->src_cover.pos;
+    destoff = encInfo->stego_cover.pos;
     if (srcoff == destoff)
     {
-          printf("Offset validation passed: src = %d, dest = %d\n", srcoff, destoff);
+          printf("Offset validation passed: src = %ld, dest = %ld\n", srcoff, destoff);
         return e_success;
     }
     else
@@ -235,23 +503,25 @@ Status encode_secret_file_extn_size(int size, EncodeInfo *encInfo)
 Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo)
 {
     char image_buffer[8];
-    int src, dest;
+    long src, dest;
     int s = strlen(file_extn);
     for (int i = 0; i < s; i++)
     {
-        fread(image_buffer, 1, 8, encInfo->fptr_src_image);
-        if (encInfo->fptr_src_image == NULL)
+        if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, 8) != 8)
         {
             return e_failure;
         }
         encode_byte_to_lsb(file_extn[i], image_buffer);
-        fwrite(image_buffer, 1, 8, encInfo->fptr_stego_image);
+        if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, 8) != e_success)
+        {
+            return e_failure;
+        }
     }
-    src = ftell(encInfo->fptr_src_image);
-    dest = ftell(encInfo->fptr_stego_image);
+    src = encInfo->src_cover.pos;
+    dest = encInfo->stego_cover.pos;
     if (src == dest)
     {
-        printf("Offset validation passed: src = %d, dest = %d\n", src, dest);
+        printf("Offset validation passed: src = %ld, dest = %ld\n", src, dest);
         return e_success;
     }
     return e_failure;
@@ -260,29 +530,29 @@ Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo)
 Status encode_secret_file_size(long file_size, EncodeInfo *encInfo)
 {
     char image_buffer[32];
-    if (fread(image_buffer, 1, 32, encInfo->fptr_src_image) != 32)
+    if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, 32) != 32)
     {
         printf(RED"ERROR: Unable to read 32 bytes from source image.\n"RESET);
         return e_failure;
     }
     encode_size_to_lsb((int)file_size, image_buffer);
-    if (fwrite(image_buffer, 1, 32, encInfo->fptr_stego_image) != 32)
+    if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, 32) != e_success)
     {
         printf(RED"ERROR: Unable to write encoded size to stego image.\n"RESET);
         return e_failure;
     }
 
-    int src_pos = ftell(encInfo->fptr_src_image);
-    int dest_pos = ftell(encInfo->fptr_stego_image);
+    long src_pos = encInfo->src_cover.pos;
+    long dest_pos = encInfo->stego_cover.pos;
     if (src_pos == dest_pos)
     {
-        printf("Offset validation passed: src = %d, dest = %d\n", src_pos, dest_pos);
+        printf("Offset validation passed: src = %ld, dest = %ld\n", src_pos, dest_pos);
         return e_success;
     }
     return e_failure;
 }
 
-Status encode_secret_file_data(EncodeInfo *encInfo)
+Status read_secret_payload(EncodeInfo *encInfo, char **payload, long *size)
 {
     char *secret_data = malloc(encInfo->size_secret_file);
     if (!secret_data)
@@ -292,54 +562,169 @@ Status encode_secret_file_data(EncodeInfo *encInfo)
     }
 
     rewind(encInfo->fptr_secret);
-    if (fread(secret_data, 1, encInfo->size_secret_file, encInfo->fptr_secret) != encInfo->size_secret_file)
+    if (fread(secret_data, 1, encInfo->size_secret_file, encInfo->fptr_secret) != (size_t)encInfo->size_secret_file)
     {
         printf(RED"ERROR: Unable to read entire secret file into memory.\n"RESET);
         free(secret_data);
         return e_failure;
     }
+    if (encInfo->verify)
+    {
+        encInfo->payload_digest = payload_digest((unsigned char *)secret_data, encInfo->size_secret_file);
+    }
 
-    char image_buffer[8];
-    for (long i = 0; i < encInfo->size_secret_file; i++)
+    // Embed the RS coded payload instead of the raw data
+    *size = encInfo->size_secret_file;
+    if (encInfo->fec_parity != 0)
     {
-        if (fread(image_buffer, 1, 8, encInfo->fptr_src_image) != 8)
+        *size = fec_encoded_size(encInfo->size_secret_file, encInfo->fec_parity);
+        char *coded = malloc(*size);
+        if (!coded)
         {
-            printf(RED"ERROR: Unable to read 8 bytes from source image.\n"RESET);
+            printf(RED"ERROR: Memory allocation failed.\n"RESET);
             free(secret_data);
             return e_failure;
         }
-        encode_byte_to_lsb(secret_data[i], image_buffer);
-        if (fwrite(image_buffer, 1, 8, encInfo->fptr_stego_image) != 8)
+        fec_encode((unsigned char *)secret_data, encInfo->size_secret_file, encInfo->fec_parity, (unsigned char *)coded);
+        free(secret_data);
+        secret_data = coded;
+    }
+
+    *payload = secret_data;
+    return e_success;
+}
+
+Status encode_secret_file_data(EncodeInfo *encInfo)
+{
+    char *secret_data = encInfo->payload;
+    long size = encInfo->payload_size;
+
+    if (encInfo->region.enabled || encInfo->adaptive.enabled)
+    {
+        return encInfo->adaptive.enabled ? encode_data_adaptive((unsigned char *)secret_data, size, encInfo)
+                                         : encode_data_into_runs((unsigned char *)secret_data, size, encInfo);
+    }
+
+    // Embed in chunks through the kernel picked for this image
+    long chunk_bytes = lsb_image_bytes_for(&encInfo->kernel, DATA_CHUNK_SIZE);
+    unsigned char *image_buffer = malloc(chunk_bytes);
+    if (!image_buffer)
+    {
+        printf(RED"ERROR: Memory allocation failed.\n"RESET);
+        return e_failure;
+    }
+
+    for (long i = 0; i < size; i += DATA_CHUNK_SIZE)
+    {
+        long n = size - i;
+        if (n > DATA_CHUNK_SIZE)
+            n = DATA_CHUNK_SIZE;
+        long image_bytes = lsb_image_bytes_for(&encInfo->kernel, n);
+
+        if (cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, image_bytes) != image_bytes)
         {
-            printf(RED"ERROR: Unable to write 8 encoded bytes.\n"RESET);
-            free(secret_data);
+            printf(RED"ERROR: Unable to read %ld bytes from source image.\n"RESET, image_bytes);
+            free(image_buffer);
+            return e_failure;
+        }
+        lsb_embed(&encInfo->kernel, (unsigned char *)secret_data + i, n, image_buffer);
+        if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, image_bytes) != e_success)
+        {
+            printf(RED"ERROR: Unable to write %ld encoded bytes.\n"RESET, image_bytes);
+            free(image_buffer);
             return e_failure;
         }
     }
 
-    free(secret_data);
-    long src_pos = ftell(encInfo->fptr_src_image);
-    long dest_pos = ftell(encInfo->fptr_stego_image);
+    free(image_buffer);
+    long src_pos = encInfo->src_cover.pos;
+    long dest_pos = encInfo->stego_cover.pos;
     if (src_pos == dest_pos)
     {
         printf("Offset validation passed: src = %ld, dest = %ld\n", src_pos, dest_pos);
         return e_success;
     }
-    return e_success;
+    return e_failure;
+}
+
+Status encode_data_into_runs(const unsigned char *data, long size, EncodeInfo *encInfo)
+{
+    RunIndex *index = &encInfo->runs;
+    long pos = encInfo->src_cover.pos;
+    long done = 0;
+
+    unsigned char *image_buffer = malloc(index->max_length);
+    if (!image_buffer)
+    {
+        printf(RED"ERROR: Memory allocation failed.\n"RESET);
+        return e_failure;
+    }
+
+    // Copy the cover forward, touching only the runs the payload needs
+    for (long r = 0; r < index->count && done < size; r++)
+    {
+        EmbedRun *run = &index->runs[r];
+        long n = run_payload_bytes(run, &encInfo->kernel);
+        if (n > size - done)
+            n = size - done;
+        long image_bytes = lsb_image_bytes_for(&encInfo->kernel, n);
+
+        if (cover_copy(&encInfo->src_cover, &encInfo->stego_cover, run->offset - pos) != e_success ||
+            cover_read(&encInfo->src_cover, (unsigned char *)image_buffer, image_bytes) != image_bytes)
+        {
+            printf(RED"ERROR: Unable to read region run from source image.\n"RESET);
+            free(image_buffer);
+            return e_failure;
+        }
+        lsb_embed(&encInfo->kernel, data + done, n, image_buffer);
+        if (cover_write(&encInfo->stego_cover, (unsigned char *)image_buffer, image_bytes) != e_success)
+        {
+            printf(RED"ERROR: Unable to write region run to stego image.\n"RESET);
+            free(image_buffer);
+            return e_failure;
+        }
+
+        pos = run->offset + image_bytes;
+        done += n;
+    }
+
+    free(image_buffer);
+    free_run_index(index);
+    return done == size ? e_success : e_failure;
+}
+
+Status encode_data_adaptive(const unsigned char *data, long size, EncodeInfo *encInfo)
+{
+    AdaptiveMap *map = &encInfo->adaptive;
+    long pos = encInfo->src_cover.pos;
+
+    // The header is already written, the rest of the stream comes from the map
+    Status ret = pos == map->start ? adaptive_embed(map, 0, data, size) : e_failure;
+    if (ret == e_success)
+    {
+        ret = cover_write(&encInfo->stego_cover, map->pixels + pos, map->size - pos);
+    }
+    if (ret == e_success)
+    {
+        ret = cover_seek(&encInfo->src_cover, map->size);
+    }
+    if (ret != e_success)
+    {
+        printf(RED"ERROR: Unable to write adaptive carriers to stego image.\n"RESET);
+    }
+    free_adaptive_map(map);
+    return ret;
 }
 
-Status copy_remaining_img_data(FILE *fptr_src, FILE *fptr_dest)
+Status copy_remaining_img_data(Cover *src, Cover *dest)
 {
-    char buffer[1024];
-    while (!feof(fptr_src))
+    if (cover_finish(dest, src) != e_success)
     {
-        size_t n = fread(buffer, 1, sizeof(buffer), fptr_src);
-        if (n > 0)
-            fwrite(buffer, 1, n, fptr_dest);
+        return e_failure;
     }
 
-    long src_offset = ftell(fptr_src);
-    long dest_offset = ftell(fptr_dest);
+    long src_offset = src->pos;
+    long dest_offset = dest->pos;
 
     if (src_offset == dest_offset)
     {
@@ -363,51 +748,161 @@ Status encode_byte_to_lsb(char data, char *image_buffer)
     return e_success;
 }
 
-Status encode_size_to_lsb(int size, char *imageBuffer)
+Status encode_uint_to_lsb(uint value, char *imageBuffer)
 {
     for (int i = 0; i < 32; i++)
     {
         imageBuffer[i] = imageBuffer[i] & (~1);
-        int bit = (size >> (31 - i)) & 1;
+        int bit = (value >> (31 - i)) & 1;
         imageBuffer[i] |= bit;
     }
     return e_success;
 }
 
-Status do_encoding(EncodeInfo *encInfo)
+Status encode_size_to_lsb(int size, char *imageBuffer)
+{
+    return encode_uint_to_lsb((uint)size, imageBuffer);
+}
+
+/*
+ * Read the finished stego image back through the decoder and check the
+ * payload digest. This covers whatever the format did to the pixels on
+ * the way out (PNG filters and deflate included), not just the buffers.
+ */
+static Status verify_stego_image(EncodeInfo *encInfo)
+{
+    DecodeInfo decInfo;
+    char *argv[] = {"stego", "-d", (char *)encInfo->src_format->stego_name, NULL};
+
+    if (read_and_validate_decode_args(argv, &decInfo) != e_success)
+    {
+        return e_failure;
+    }
+    // Update encodes to a temporary name, the format is the cover's
+    decInfo.stego_image_fname = encInfo->stego_image_fname;
+    decInfo.raw_geometry = encInfo->raw_geometry;
+    decInfo.verify_only = 1;
+    if (do_decoding(&decInfo) != e_success || decInfo.payload_digest != encInfo->payload_digest)
+    {
+        printf(RED"ERROR: Verification of %s failed.\n"RESET, encInfo->stego_image_fname);
+        return e_failure;
+    }
+    printf(GREEN"Embedded data verified, payload digest %08x\n"RESET, encInfo->payload_digest);
+    return e_success;
+}
+
+/* Runs the encoding stages in order, stops at the first one that fails */
+static Status encode_stages(EncodeInfo *encInfo)
 {
-    if (open_files(encInfo) == e_success)
+    Status ret;
+
+    profile_begin("open_files", NULL);
+    ret = open_files(encInfo);
+    profile_end(NULL);
+    if (ret == e_success)
     {
         printf("All the files are opened to perform operations:\n");
     }
+    else
+    {
+        return e_failure;
+    }
 
-    if (check_capacity(encInfo) == e_success)
+    char *extn = strrchr(encInfo->secret_fname, '.');
+    if (extn != NULL && strlen(extn) <= MAX_EXTN_SIZE)
+    {
+        strcpy(encInfo->extn_secret_file, extn);
+    }
+    else
+    {
+        printf("No extension found in secret file.\n");
+    }
+
+    profile_begin("check_capacity", NULL);
+    ret = check_capacity(encInfo);
+    profile_end(NULL);
+    if (ret == e_success)
     {
         printf("The capacity is validated:\n");
     }
+    else
+    {
+        printf(RED"ERROR: Secret file does not fit in the source image.\n"RESET);
+        return e_failure;
+    }
 
-    if (copy_bmp_header(encInfo->fptr_src_image, encInfo->fptr_stego_image) == e_success)
+    // The digest covers the payload, so it is read before the header is written
+    profile_begin("read_secret_payload", NULL);
+    ret = read_secret_payload(encInfo, &encInfo->payload, &encInfo->payload_size);
+    profile_end(NULL);
+    if (ret != e_success)
+    {
+        return e_failure;
+    }
+
+    profile_begin("copy_cover_header", NULL);
+    ret = copy_cover_header(encInfo);
+    profile_end(NULL);
+    if (ret == e_success)
     {
         printf("Header is copied Successfully\n");
     }
+    else
+    {
+        printf(RED"ERROR: Copying image header failed.\n"RESET);
+        return e_failure;
+    }
 
-    if (encode_magic_string(MAGIC_STRING, encInfo) == e_success)
+    profile_begin("encode_magic_string", &encInfo->stego_cover.pos);
+    ret = encode_magic_string(MAGIC_STRING, encInfo);
+    profile_end(&encInfo->stego_cover.pos);
+    if (ret == e_success)
     {
         printf("Magic string is encoded\n");
     }
+    else
+    {
+        printf(RED"ERROR: Encoding magic string failed.\n"RESET);
+        return e_failure;
+    }
 
-    char *extn = strstr(encInfo->secret_fname, ".");
-    if (extn != NULL)
+    profile_begin("encode_stego_version", &encInfo->stego_cover.pos);
+    ret = encode_stego_version(encInfo);
+    profile_end(&encInfo->stego_cover.pos);
+    if (ret != e_success)
     {
-        strcpy(encInfo->extn_secret_file, extn);
+        return e_failure;
     }
-    else
+
+    profile_begin("encode_stego_flags", &encInfo->stego_cover.pos);
+    ret = encode_stego_flags(encInfo);
+    if (ret == e_success && encInfo->region.enabled)
     {
-        printf("No extension found in secret file.\n");
+        ret = encode_embed_region(encInfo);
+    }
+    if (ret == e_success && encInfo->fec_parity != 0)
+    {
+        ret = encode_fec_params(encInfo);
+    }
+    if (ret == e_success && encInfo->adaptive.enabled)
+    {
+        ret = encode_adaptive_params(encInfo);
+    }
+    if (ret == e_success && encInfo->verify)
+    {
+        ret = encode_payload_digest(encInfo);
+    }
+    profile_end(&encInfo->stego_cover.pos);
+    if (ret != e_success)
+    {
+        return e_failure;
     }
 
     int s = strlen(encInfo->extn_secret_file);
-    if (encode_secret_file_extn_size(s, encInfo) == e_success)
+    profile_begin("encode_secret_file_extn_size", &encInfo->stego_cover.pos);
+    ret = encode_secret_file_extn_size(s, encInfo);
+    profile_end(&encInfo->stego_cover.pos);
+    if (ret == e_success)
     {
         printf("Secret file extension size copied\n");
     }
@@ -417,7 +912,10 @@ Status do_encoding(EncodeInfo *encInfo)
         return e_failure;
     }
 
-    if (encode_secret_file_extn(encInfo->extn_secret_file, encInfo) != e_success)
+    profile_begin("encode_secret_file_extn", &encInfo->stego_cover.pos);
+    ret = encode_secret_file_extn(encInfo->extn_secret_file, encInfo);
+    profile_end(&encInfo->stego_cover.pos);
+    if (ret != e_success)
     {
         printf(RED"ERROR: Failed to encode secret file extension.\n"RESET);
         return e_failure;
@@ -428,19 +926,33 @@ Status do_encoding(EncodeInfo *encInfo)
     }
 
     encInfo->size_secret_file = get_file_size(encInfo->fptr_secret);
-    if (encode_secret_file_size(encInfo->size_secret_file, encInfo) != e_success)
+    profile_begin("encode_secret_file_size", &encInfo->stego_cover.pos);
+    ret = encode_secret_file_size(encInfo->size_secret_file, encInfo);
+    profile_end(&encInfo->stego_cover.pos);
+    if (ret != e_success)
     {
         printf(RED"ERROR: Encoding secret file size failed.\n"RESET);
         return e_failure;
     }
     printf("Secret file size encoded successfully.\n");
 
-    if (encode_secret_file_data(encInfo) == e_success)
+    profile_begin("encode_secret_file_data", &encInfo->stego_cover.pos);
+    ret = encode_secret_file_data(encInfo);
+    profile_end(&encInfo->stego_cover.pos);
+    if (ret == e_success)
     {
         printf("Secret file data is encoded\n");
     }
+    else
+    {
+        printf(RED"ERROR: Encoding secret file data failed.\n"RESET);
+        return e_failure;
+    }
 
-    if (copy_remaining_img_data(encInfo->fptr_src_image, encInfo->fptr_stego_image) != e_success)
+    profile_begin("copy_remaining_img_data", &encInfo->stego_cover.pos);
+    ret = copy_remaining_img_data(&encInfo->src_cover, &encInfo->stego_cover);
+    profile_end(&encInfo->stego_cover.pos);
+    if (ret != e_success)
     {
         printf(RED"ERROR: Copying remaining image data failed.\n"RESET);
         return e_failure;
@@ -448,4 +960,51 @@ Status do_encoding(EncodeInfo *encInfo)
 
     printf(GREEN"Remaining image data copied successfully.\n"RESET);
     return e_success;
-}
\ No newline at end of file
+}
+
+/*
+ * Every exit frees the payload, the run index and the adaptive map and
+ * closes what was opened, so the stego image is flushed. With --verify
+ * the flushed image is then checked. A failed encode removes the stego
+ * image it started rather than leave half of it.
+ */
+Status do_encoding(EncodeInfo *encInfo)
+{
+    encInfo->fptr_src_image = NULL;
+    encInfo->fptr_secret = NULL;
+    encInfo->fptr_stego_image = NULL;
+    encInfo->payload = NULL;
+    memset(&encInfo->src_cover, 0, sizeof(encInfo->src_cover));
+    memset(&encInfo->stego_cover, 0, sizeof(encInfo->stego_cover));
+    memset(&encInfo->runs, 0, sizeof(encInfo->runs));
+
+    Status ret = encode_stages(encInfo);
+
+    free(encInfo->payload);
+    encInfo->payload = NULL;
+    free_run_index(&encInfo->runs);
+    free_adaptive_map(&encInfo->adaptive);
+    cover_close(&encInfo->src_cover);
+    cover_close(&encInfo->stego_cover);
+    if (encInfo->fptr_src_image)
+        fclose(encInfo->fptr_src_image);
+    if (encInfo->fptr_secret)
+        fclose(encInfo->fptr_secret);
+    if (encInfo->fptr_stego_image)
+    {
+        if (fclose(encInfo->fptr_stego_image) != 0)
+        {
+            printf(RED"ERROR: Unable to flush stego image.\n"RESET);
+            ret = e_failure;
+        }
+        if (ret == e_success && encInfo->verify)
+        {
+            ret = verify_stego_image(encInfo);
+        }
+        if (ret != e_success)
+        {
+            remove(encInfo->stego_image_fname);
+        }
+    }
+    return ret;
+}
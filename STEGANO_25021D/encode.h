@@ -3,7 +3,14 @@
 #include <stdio.h>
 
 #include "types.h" // Contains user defined types
-#define MAGIC_STRING "#*"
+#include "common.h" // Contains stego header layout
+#include "lsb.h"    // Contains embed kernels
+#include "region.h" // Contains channel/region runs
+#include "cover.h"  // Contains cover image formats
+#include "fec.h"    // Contains payload error correction
+#include "archive.h" // Contains multi-file payloads
+#include "adaptive.h" // Contains texture-driven carriers
+#include "verify.h"   // Contains the payload digest
 
 /*
  * Structure to store information required for
@@ -17,18 +24,33 @@ typedef struct _EncodeInfo
     /* Source Image info */
     char *src_image_fname; // To store the src image name
     FILE *fptr_src_image;  // To store the address of the src image
-    uint image_capacity;   // To store the size of image
+    const CoverFormat *src_format; // To store the image format (by suffix)
+    CoverGeometry raw_geometry;    // --raw geometry of a .raw cover
+    Cover src_cover;       // To store the parsed src image
+    long image_capacity;   // To store the size of image
 
     /* Secret File Info */
     char *secret_fname;       // To store the secret file name
     FILE *fptr_secret;        // To store the secret file address
-    char extn_secret_file[5]; // To store the Secret file extension
+    char **archive_files;     // Files of a multi-file payload
+    int archive_count;        // Number of archive files, 0 = single secret file
+    char extn_secret_file[MAX_EXTN_SIZE + 1]; // To store the Secret file extension
     char secret_data[100];    // To store the secret data
     long size_secret_file;    // To store the size of the secret data
+    LsbKernel kernel;         // Embed kernel chosen for this image
+    EmbedRegion region;       // Channel/region restriction (optional)
+    RunIndex runs;            // Embeddable runs when region is enabled
+    int fec_parity;           // RS parity bytes per codeword, 0 = no FEC
+    AdaptiveMap adaptive;     // Texture-driven carriers (optional)
+    int verify;               // Store a digest and check the written image against it
+    uint payload_digest;      // CRC-32 of the secret data (verify only)
+    char *payload;            // Secret data as embedded (RS coded when FEC is on)
+    long payload_size;        // Bytes of payload
 
     /* Stego Image Info */
     char *stego_image_fname; // To store the dest file name
     FILE *fptr_stego_image;  // To store the address of stego image
+    Cover stego_cover;       // To store the stego image being written
 
 } EncodeInfo;
 
@@ -43,21 +65,42 @@ Status do_encoding(EncodeInfo *encInfo);
 /* Get File pointers for i/p and o/p files */
 Status open_files(EncodeInfo *encInfo);
 
+/* Open the secret file, or build the archive payload in a temporary file */
+Status open_secret_file(EncodeInfo *encInfo);
+
 /* check capacity */
 Status check_capacity(EncodeInfo *encInfo);
 
-/* Get image size */
-uint get_image_size_for_bmp(FILE *fptr_image);
-
 /* Get file size */
 uint get_file_size(FILE *fptr);
 
-/* Copy bmp image header */
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image);
+/* Copy image header (starts the stego cover) */
+Status copy_cover_header(EncodeInfo *encInfo);
 
 /* Store Magic String */
 Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo);
 
+/* Store header format version */
+Status encode_stego_version(EncodeInfo *encInfo);
+
+/* Store header flags */
+Status encode_stego_flags(EncodeInfo *encInfo);
+
+/* Store channel/region layout */
+Status encode_embed_region(EncodeInfo *encInfo);
+
+/* Store FEC parity count */
+Status encode_fec_params(EncodeInfo *encInfo);
+
+/* Store adaptive cost threshold */
+Status encode_adaptive_params(EncodeInfo *encInfo);
+
+/* Store payload digest */
+Status encode_payload_digest(EncodeInfo *encInfo);
+
+/* Image bytes taken by the stego header */
+long stego_header_image_bytes(EncodeInfo *encInfo);
+
 /*Encode extension size*/
 Status encode_secret_file_extn_size(int size, EncodeInfo *encInfo);
 
@@ -67,16 +110,29 @@ Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo);
 /* Encode secret file size */
 Status encode_secret_file_size(long file_size, EncodeInfo *encInfo);
 
-/* Encode secret file data*/
+/* Read the secret file into memory, RS coded when FEC is on.
+ * Sets size to the bytes that get embedded, caller frees payload.
+ * With verify on, also sets payload_digest from the raw data */
+Status read_secret_payload(EncodeInfo *encInfo, char **payload, long *size);
+
+/* Encode secret file data (the payload read by read_secret_payload) */
 Status encode_secret_file_data(EncodeInfo *encInfo);
 
-/* Encode a byte into LSB of image data array */
+/* Encode secret data into the region runs */
+Status encode_data_into_runs(const unsigned char *data, long size, EncodeInfo *encInfo);
+
+/* Encode secret data into the adaptive carriers, writes the rest of the pixel stream */
+Status encode_data_adaptive(const unsigned char *data, long size, EncodeInfo *encInfo);
+
+/* Encode a byte into LSB of image data array
+ * Reference bit loop, any faster kernel must produce identical bytes */
 Status encode_byte_to_lsb(char data, char *image_buffer);
 
 // Encode a size to lsb
+Status encode_uint_to_lsb(uint value, char *imageBuffer);
 Status encode_size_to_lsb(int size, char *imageBuffer);
 
 /* Copy remaining image bytes from src to stego image after encoding */
-Status copy_remaining_img_data(FILE *fptr_src, FILE *fptr_dest);
+Status copy_remaining_img_data(Cover *src, Cover *dest);
 
 #endif
@@ -0,0 +1,333 @@
+/*
+Reed-Solomon FEC for the embedded payload.
+GF(256) with the 0x11d polynomial, generator roots alpha^0 .. alpha^(p-1).
+Multiplies by the generator go through a 256 row table built once per
+parity count, so the division by g(x) is one row lookup and a 64-bit
+wide XOR per payload byte. The decoder runs the same division and only
+computes syndromes (log/exp multiplies) for codewords that come out
+non-zero, so undamaged payloads cost about as much as encoding.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "fec.h"
+
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+#define RS_N 255
+
+/* Codewords handled together so interleaving touches whole cache lines */
+#define FEC_GROUP 32
+
+static unsigned char gf_exp[2 * RS_N];
+static int gf_log[256];
+
+/* Tables for the current parity count */
+static int table_parity;
+static uint64_t gen_rows[256][MAX_FEC_PARITY / 8];     // bytes f * g[j + 1], zero padded
+
+static unsigned char gf_mul(unsigned char a, unsigned char b)
+{
+    if (a == 0 || b == 0)
+        return 0;
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static unsigned char gf_div(unsigned char a, unsigned char b)
+{
+    if (a == 0)
+        return 0;
+    return gf_exp[gf_log[a] + RS_N - gf_log[b]];
+}
+
+static void fec_init_tables(int parity)
+{
+    if (table_parity == parity)
+        return;
+
+    int x = 1;
+    for (int i = 0; i < RS_N; i++)
+    {
+        gf_exp[i] = gf_exp[i + RS_N] = x;
+        gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100)
+            x ^= 0x11d;
+    }
+
+    // g(x) = (x - alpha^0)(x - alpha^1)...(x - alpha^(p-1)), g[0] = 1 is the x^p term
+    unsigned char gen[MAX_FEC_PARITY + 1] = {1};
+    for (int i = 0; i < parity; i++)
+    {
+        for (int j = i + 1; j > 0; j--)
+            gen[j] ^= gf_mul(gen[j - 1], gf_exp[i]);
+    }
+
+    for (int f = 0; f < 256; f++)
+    {
+        unsigned char row[MAX_FEC_PARITY] = {0};
+        for (int j = 0; j < parity; j++)
+            row[j] = gf_mul(f, gen[j + 1]);
+        memcpy(gen_rows[f], row, sizeof(row));
+    }
+    table_parity = parity;
+}
+
+int fec_parse_args(int argc, char *argv[], int *parity)
+{
+    int j = 0;
+
+    *parity = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--fec") == 0)
+            *parity = DEFAULT_FEC_PARITY;
+        else if (strncmp(argv[i], "--fec=", 6) == 0)
+            *parity = atoi(argv[i] + 6) > 0 ? atoi(argv[i] + 6) : -1;   // rejected by fec_validate_parity
+        else
+            argv[j++] = argv[i];
+    }
+    argv[j] = NULL;
+    return j;
+}
+
+Status fec_validate_parity(int parity)
+{
+    if (parity < 2 || parity > MAX_FEC_PARITY)
+    {
+        printf(RED "ERROR: FEC parity must be between 2 and %d bytes per codeword.\n" RESET, MAX_FEC_PARITY);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/* Codeword count and data bytes per codeword for a payload */
+static void fec_layout(long size, int parity, long *codewords, long *data_len)
+{
+    long k = RS_N - parity;
+    *codewords = (size + k - 1) / k;
+    *data_len = *codewords ? (size + *codewords - 1) / *codewords : 0;
+}
+
+long fec_encoded_size(long size, int parity)
+{
+    long codewords, data_len;
+    fec_layout(size, parity, &codewords, &data_len);
+    return codewords * (data_len + parity);
+}
+
+/*
+ * rem = data(x) * x^p mod g(x) for each of 'count' codewords of 'len'
+ * data bytes, written to rems[g]. A remainder slides along its window:
+ * after byte i it sits at window[i + 1 .. i + p], so each step only XORs
+ * one generator row in, 8 bytes at a time. The codewords are stepped
+ * together so their independent lookup chains overlap.
+ */
+static void rs_remainders(unsigned char group[][RS_N], long count, long len, int parity,
+                          unsigned char rems[][MAX_FEC_PARITY])
+{
+    static unsigned char windows[FEC_GROUP][RS_N + MAX_FEC_PARITY];
+    int words = (parity + 7) / 8;
+
+    memset(windows, 0, sizeof(windows));
+    for (long i = 0; i < len; i++)
+    {
+        for (long g = 0; g < count; g++)
+        {
+            const uint64_t *row = gen_rows[group[g][i] ^ windows[g][i]];
+            unsigned char *dst = windows[g] + i + 1;
+            for (int w = 0; w < words; w++)
+            {
+                uint64_t v;
+                memcpy(&v, dst + 8 * w, 8);
+                v ^= row[w];
+                memcpy(dst + 8 * w, &v, 8);
+            }
+        }
+    }
+    for (long g = 0; g < count; g++)
+        memcpy(rems[g], windows[g] + len, parity);
+}
+
+Status fec_encode(const unsigned char *data, long size, int parity, unsigned char *out)
+{
+    long codewords, data_len;
+    static unsigned char group[FEC_GROUP][RS_N];
+    static unsigned char rems[FEC_GROUP][MAX_FEC_PARITY];
+
+    fec_init_tables(parity);
+    fec_layout(size, parity, &codewords, &data_len);
+
+    for (long c0 = 0; c0 < codewords; c0 += FEC_GROUP)
+    {
+        long count = codewords - c0 < FEC_GROUP ? codewords - c0 : FEC_GROUP;
+
+        for (long g = 0; g < count; g++)
+        {
+            // Data part, the last codeword is zero padded
+            unsigned char *cw = group[g];
+            long start = (c0 + g) * data_len;
+            long n = size - start < data_len ? size - start : data_len;
+            memcpy(cw, data + start, n);
+            memset(cw + n, 0, data_len - n);
+        }
+
+        // Parity = data(x) * x^p mod g(x), kept in the codeword tail
+        rs_remainders(group, count, data_len, parity, rems);
+        for (long g = 0; g < count; g++)
+            memcpy(group[g] + data_len, rems[g], parity);
+
+        // Byte i of codeword c goes to i * codewords + c
+        for (long i = 0; i < data_len + parity; i++)
+        {
+            unsigned char *dst = out + i * codewords + c0;
+            for (long g = 0; g < count; g++)
+                dst[g] = group[g][i];
+        }
+    }
+    return e_success;
+}
+
+/*
+ * Correct one codeword of length n in place, returns errors fixed or -1.
+ * rem is the received codeword mod g(x), non-zero when damaged. Since
+ * g(alpha^i) = 0 the syndromes are just rem evaluated at each root.
+ */
+static int rs_correct(unsigned char *cw, int n, int parity, const unsigned char *rem)
+{
+    unsigned char syn[MAX_FEC_PARITY] = {0};
+
+    for (int i = 0; i < parity; i++)
+    {
+        for (int j = 0; j < parity; j++)
+            syn[i] = gf_mul(syn[i], gf_exp[i]) ^ rem[j];
+    }
+
+    // Berlekamp-Massey: error locator lambda(x) = prod(1 - X_k x)
+    unsigned char lambda[MAX_FEC_PARITY + 1] = {1}, prev[MAX_FEC_PARITY + 1] = {1}, temp[MAX_FEC_PARITY + 1];
+    int len = 0, shift = 1;
+    unsigned char prev_disc = 1;
+
+    for (int r = 0; r < parity; r++)
+    {
+        unsigned char disc = syn[r];
+        for (int i = 1; i <= len; i++)
+            disc ^= gf_mul(lambda[i], syn[r - i]);
+
+        if (disc == 0)
+        {
+            shift++;
+            continue;
+        }
+
+        unsigned char scale = gf_div(disc, prev_disc);
+        memcpy(temp, lambda, sizeof(temp));
+        for (int i = 0; i + shift <= parity; i++)
+            lambda[i + shift] ^= gf_mul(scale, prev[i]);
+
+        if (2 * len <= r)
+        {
+            len = r + 1 - len;
+            memcpy(prev, temp, sizeof(prev));
+            prev_disc = disc;
+            shift = 1;
+        }
+        else
+        {
+            shift++;
+        }
+    }
+    if (2 * len > parity)
+        return -1;
+
+    // Error evaluator omega(x) = S(x) lambda(x) mod x^p
+    unsigned char omega[MAX_FEC_PARITY] = {0};
+    for (int i = 0; i < parity; i++)
+    {
+        for (int j = 0; j <= len && j <= i; j++)
+            omega[i] ^= gf_mul(syn[i - j], lambda[j]);
+    }
+
+    // Chien search over the (shortened) codeword, Forney for the values
+    int found = 0;
+    for (int k = 0; k < n; k++)
+    {
+        int power = n - 1 - k;                              // X = alpha^power
+        int inv = (RS_N - power) % RS_N;                    // X^-1
+
+        unsigned char value = 0, deriv = 0, eval = 0;
+        for (int i = len; i >= 0; i--)
+        {
+            value = gf_mul(value, gf_exp[inv]) ^ lambda[i];
+            if (i & 1)
+                deriv ^= gf_mul(lambda[i], gf_exp[(inv * (i - 1)) % RS_N]);
+        }
+        if (value != 0)
+            continue;
+
+        for (int i = parity - 1; i >= 0; i--)
+            eval = gf_mul(eval, gf_exp[inv]) ^ omega[i];
+        if (deriv == 0)
+            return -1;
+
+        cw[k] ^= gf_mul(gf_exp[power], gf_div(eval, deriv));
+        found++;
+    }
+
+    // Roots outside the shortened codeword mean too many errors
+    return found == len ? found : -1;
+}
+
+Status fec_decode(const unsigned char *coded, long size, int parity, unsigned char *data, long *corrected)
+{
+    long codewords, data_len;
+    static unsigned char group[FEC_GROUP][RS_N];
+    static unsigned char rems[FEC_GROUP][MAX_FEC_PARITY];
+
+    fec_init_tables(parity);
+    fec_layout(size, parity, &codewords, &data_len);
+    *corrected = 0;
+
+    for (long c0 = 0; c0 < codewords; c0 += FEC_GROUP)
+    {
+        long count = codewords - c0 < FEC_GROUP ? codewords - c0 : FEC_GROUP;
+
+        for (long i = 0; i < data_len + parity; i++)
+        {
+            const unsigned char *src = coded + i * codewords + c0;
+            for (long g = 0; g < count; g++)
+                group[g][i] = src[g];
+        }
+
+        rs_remainders(group, count, data_len, parity, rems);
+        for (long g = 0; g < count; g++)
+        {
+            unsigned char *cw = group[g];
+            unsigned char *rem = rems[g];
+
+            // Received parity XOR recomputed parity = codeword mod g(x)
+            int nonzero = 0;
+            for (int j = 0; j < parity; j++)
+            {
+                rem[j] ^= cw[data_len + j];
+                nonzero |= rem[j];
+            }
+
+            int fixed = nonzero ? rs_correct(cw, data_len + parity, parity, rem) : 0;
+            if (fixed < 0)
+            {
+                printf(RED "ERROR: Codeword %ld has more errors than FEC can correct.\n" RESET, c0 + g);
+                return e_failure;
+            }
+            *corrected += fixed;
+
+            long start = (c0 + g) * data_len;
+            long n = size - start < data_len ? size - start : data_len;
+            memcpy(data + start, cw, n);
+        }
+    }
+    return e_success;
+}
@@ -0,0 +1,40 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include "types.h"
+
+/* Parity bytes per codeword for a bare --fec, RS(255,223) */
+#define DEFAULT_FEC_PARITY 32
+
+/* Largest parity count accepted, leaves at least 127 data bytes per codeword */
+#define MAX_FEC_PARITY 128
+
+/*
+ * Reed-Solomon forward error correction over GF(256).
+ * The payload is split into equal (shortened) RS codewords of at most
+ * 255 bytes, each with 'parity' check bytes, and the codewords are
+ * interleaved byte by byte so damage to a run of consecutive pixels
+ * is spread thinly over all of them. Each codeword corrects up to
+ * parity / 2 damaged bytes.
+ */
+
+/* Parse and strip --fec / --fec=<parity> from argv, returns new argc */
+int fec_parse_args(int argc, char *argv[], int *parity);
+
+/* Check a parity count read from the command line or a header */
+Status fec_validate_parity(int parity);
+
+/* Bytes actually embedded for a 'size' byte payload */
+long fec_encoded_size(long size, int parity);
+
+/* Protect 'size' payload bytes, out must hold fec_encoded_size() bytes */
+Status fec_encode(const unsigned char *data, long size, int parity, unsigned char *out);
+
+/*
+ * Correct and recover 'size' payload bytes from the embedded stream.
+ * coded holds fec_encoded_size() bytes. Fails if any codeword has
+ * more errors than it can correct.
+ */
+Status fec_decode(const unsigned char *coded, long size, int parity, unsigned char *data, long *corrected);
+
+#endif
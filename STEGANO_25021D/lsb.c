@@ -0,0 +1,302 @@
+/*
+Specialised LSB embed/extract kernels.
+Every supported combination of bits per channel (1/2/4), bytes per pixel
+(3/4) and channel mask gets its own instance of the same inline routine,
+with the layout passed as constants so the compiler folds the slot
+offsets and unrolls the period loop. lsb_select_kernel picks the instance
+once per image. Masks that cover every channel degrade to a flat stream,
+and the common 1-bit flat case uses a 64-bit table driven kernel that
+handles 8 image bytes per data byte at once.
+The reference bit loops in encode.c/decode.c define the format, every
+kernel here must produce identical image bytes.
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include "lsb.h"
+
+#if defined(__GNUC__)
+#define LSB_INLINE static inline __attribute__((always_inline))
+#else
+#define LSB_INLINE static inline
+#endif
+
+/* Number of carrier channels in a mask */
+#define MASK_SLOTS(m) (((m) & 1) + (((m) >> 1) & 1) + (((m) >> 2) & 1) + (((m) >> 3) & 1))
+
+/* Channel index of the n-th set bit in mask */
+LSB_INLINE int nth_channel(uint mask, int n)
+{
+    for (int c = 0;; c++)
+    {
+        if (((mask >> c) & 1) && n-- == 0)
+            return c;
+    }
+}
+
+/* Pixels in one period: smallest count whose carrier bits fill whole bytes */
+LSB_INLINE int period_pixels(int slots, int bits)
+{
+    int pixel_bits = slots * bits;
+    if (pixel_bits % 8 == 0)
+        return 1;
+    if (pixel_bits % 4 == 0)
+        return 2;
+    if (pixel_bits % 2 == 0)
+        return 4;
+    return 8;
+}
+
+LSB_INLINE void embed_periods(const unsigned char *data, long periods, unsigned char *pixels,
+                              const int bits, const int bpp, const uint mask)
+{
+    const int slots = MASK_SLOTS(mask);
+    const int nslots = period_pixels(slots, bits) * slots;
+    const int nbytes = nslots * bits / 8;
+    const unsigned char low = (1u << bits) - 1;
+
+    for (long p = 0; p < periods; p++)
+    {
+        uint acc = 0;
+        for (int b = 0; b < nbytes; b++)
+            acc = (acc << 8) | data[b];
+
+#if defined(__GNUC__) && __GNUC__ >= 8
+#pragma GCC unroll 32
+#endif
+        for (int j = 0; j < nslots; j++)
+        {
+            unsigned char *q = pixels + (j / slots) * bpp + nth_channel(mask, j % slots);
+            *q = (*q & ~low) | ((acc >> ((nslots - 1 - j) * bits)) & low);
+        }
+        data += nbytes;
+        pixels += (nslots / slots) * bpp;
+    }
+}
+
+LSB_INLINE void extract_periods(const unsigned char *pixels, long periods, unsigned char *data,
+                                const int bits, const int bpp, const uint mask)
+{
+    const int slots = MASK_SLOTS(mask);
+    const int nslots = period_pixels(slots, bits) * slots;
+    const int nbytes = nslots * bits / 8;
+    const unsigned char low = (1u << bits) - 1;
+
+    for (long p = 0; p < periods; p++)
+    {
+        uint acc = 0;
+
+#if defined(__GNUC__) && __GNUC__ >= 8
+#pragma GCC unroll 32
+#endif
+        for (int j = 0; j < nslots; j++)
+            acc = (acc << bits) | (pixels[(j / slots) * bpp + nth_channel(mask, j % slots)] & low);
+
+        for (int b = 0; b < nbytes; b++)
+            data[b] = acc >> ((nbytes - 1 - b) * 8);
+        data += nbytes;
+        pixels += (nslots / slots) * bpp;
+    }
+}
+
+/* One instance per (bits, bpp, mask), generated from the lists below */
+#define LSB_DEFINE(BITS, BPP, MASK)                                                              \
+    static void embed_##BITS##_##BPP##_##MASK(const unsigned char *d, long n, unsigned char *p)  \
+    {                                                                                            \
+        embed_periods(d, n, p, BITS, BPP, MASK);                                                 \
+    }                                                                                            \
+    static void extract_##BITS##_##BPP##_##MASK(const unsigned char *p, long n, unsigned char *d) \
+    {                                                                                            \
+        extract_periods(p, n, d, BITS, BPP, MASK);                                               \
+    }
+
+#define LSB_ENTRY(BITS, BPP, MASK) \
+    {BITS, BPP, MASK, embed_##BITS##_##BPP##_##MASK, extract_##BITS##_##BPP##_##MASK},
+
+/* Partial masks only, full masks use the flat kernels */
+#define LSB_MASKS_3(X, BITS) \
+    X(BITS, 3, 1) X(BITS, 3, 2) X(BITS, 3, 3) X(BITS, 3, 4) X(BITS, 3, 5) X(BITS, 3, 6)
+
+#define LSB_MASKS_4(X, BITS)                                                              \
+    X(BITS, 4, 1) X(BITS, 4, 2) X(BITS, 4, 3) X(BITS, 4, 4) X(BITS, 4, 5) X(BITS, 4, 6)   \
+    X(BITS, 4, 7) X(BITS, 4, 8) X(BITS, 4, 9) X(BITS, 4, 10) X(BITS, 4, 11) X(BITS, 4, 12) \
+    X(BITS, 4, 13) X(BITS, 4, 14)
+
+#define LSB_INSTANCES(X)                                  \
+    LSB_MASKS_3(X, 1) LSB_MASKS_3(X, 2) LSB_MASKS_3(X, 4) \
+    LSB_MASKS_4(X, 1) LSB_MASKS_4(X, 2) LSB_MASKS_4(X, 4)
+
+/* Flat stream: every image byte is a carrier, bpp is irrelevant */
+#define FLAT_DEFINE(BITS) LSB_DEFINE(BITS, 1, 1)
+
+LSB_INSTANCES(LSB_DEFINE)
+FLAT_DEFINE(2)
+FLAT_DEFINE(4)
+
+static const struct
+{
+    int bits;
+    int bpp;
+    uint mask;
+    void (*embed)(const unsigned char *, long, unsigned char *);
+    void (*extract)(const unsigned char *, long, unsigned char *);
+} lsb_instances[] = {
+    LSB_INSTANCES(LSB_ENTRY)
+};
+
+/* 1-bit flat kernel: data byte b becomes 8 image LSBs, MSB first */
+#define LSB_BYTE_MASK 0x0101010101010101ULL
+
+static uint64_t spread_table[256];
+static int spread_table_ready = 0;
+
+static void build_spread_table(void)
+{
+    for (int b = 0; b < 256; b++)
+    {
+        unsigned char bytes[8];
+        for (int i = 0; i < 8; i++)
+            bytes[i] = (b >> (7 - i)) & 1;
+        memcpy(&spread_table[b], bytes, 8);
+    }
+    spread_table_ready = 1;
+}
+
+static void embed_flat_1(const unsigned char *data, long n, unsigned char *pixels)
+{
+    for (long i = 0; i < n; i++)
+    {
+        uint64_t p;
+        memcpy(&p, pixels, 8);
+        p = (p & ~LSB_BYTE_MASK) | spread_table[data[i]];
+        memcpy(pixels, &p, 8);
+        pixels += 8;
+    }
+}
+
+static void extract_flat_1(const unsigned char *pixels, long n, unsigned char *data)
+{
+    for (long i = 0; i < n; i++)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // Gather the 8 LSBs into the top byte, first image byte lands in bit 7
+        uint64_t p;
+        memcpy(&p, pixels, 8);
+        data[i] = (unsigned char)(((p & LSB_BYTE_MASK) * 0x8040201008040201ULL) >> 56);
+#else
+        unsigned char b = 0;
+        for (int j = 0; j < 8; j++)
+            b = (b << 1) | (pixels[j] & 1);
+        data[i] = b;
+#endif
+        pixels += 8;
+    }
+}
+
+Status lsb_select_kernel(int bits, int bpp, uint channel_mask, LsbKernel *kernel)
+{
+    uint full = (1u << bpp) - 1;
+
+    // Any pixel size works as a flat stream, partial masks need 3 or 4 channels
+    if ((bits != 1 && bits != 2 && bits != 4) || bpp < 1 || bpp > 4 ||
+        channel_mask == 0 || (channel_mask & ~full) != 0 ||
+        (channel_mask != full && bpp != 3 && bpp != 4))
+    {
+        return e_failure;
+    }
+
+    kernel->bits = bits;
+    kernel->bpp = bpp;
+    kernel->channel_mask = channel_mask;
+
+    if (channel_mask == full)
+    {
+        kernel->period_bytes = 1;
+        kernel->period_image_bytes = 8 / bits;
+        if (bits == 1)
+        {
+            if (!spread_table_ready)
+                build_spread_table();
+            kernel->embed = embed_flat_1;
+            kernel->extract = extract_flat_1;
+        }
+        else if (bits == 2)
+        {
+            kernel->embed = embed_2_1_1;
+            kernel->extract = extract_2_1_1;
+        }
+        else
+        {
+            kernel->embed = embed_4_1_1;
+            kernel->extract = extract_4_1_1;
+        }
+        return e_success;
+    }
+
+    for (size_t i = 0; i < sizeof(lsb_instances) / sizeof(lsb_instances[0]); i++)
+    {
+        if (lsb_instances[i].bits == bits && lsb_instances[i].bpp == bpp &&
+            lsb_instances[i].mask == channel_mask)
+        {
+            int slots = MASK_SLOTS(channel_mask);
+            int pixels = period_pixels(slots, bits);
+            kernel->period_bytes = pixels * slots * bits / 8;
+            kernel->period_image_bytes = pixels * bpp;
+            kernel->embed = lsb_instances[i].embed;
+            kernel->extract = lsb_instances[i].extract;
+            return e_success;
+        }
+    }
+    return e_failure;
+}
+
+int lsb_instance_count(void)
+{
+    return sizeof(lsb_instances) / sizeof(lsb_instances[0]);
+}
+
+Status lsb_instance_kernel(int i, LsbKernel *kernel)
+{
+    if (i < 0 || i >= lsb_instance_count() ||
+        lsb_select_kernel(lsb_instances[i].bits, lsb_instances[i].bpp, lsb_instances[i].mask, kernel) != e_success)
+    {
+        return e_failure;
+    }
+    // The layout must select this very instance
+    return kernel->embed == lsb_instances[i].embed && kernel->extract == lsb_instances[i].extract ? e_success : e_failure;
+}
+
+long lsb_image_bytes_for(const LsbKernel *kernel, long data_bytes)
+{
+    long periods = (data_bytes + kernel->period_bytes - 1) / kernel->period_bytes;
+    return periods * kernel->period_image_bytes;
+}
+
+void lsb_embed(const LsbKernel *kernel, const unsigned char *data, long n, unsigned char *pixels)
+{
+    long whole = n / kernel->period_bytes;
+    long tail = n % kernel->period_bytes;
+
+    kernel->embed(data, whole, pixels);
+    if (tail)
+    {
+        // Last partial period is zero padded
+        unsigned char last[MAX_LSB_PERIOD_BYTES] = {0};
+        memcpy(last, data + whole * kernel->period_bytes, tail);
+        kernel->embed(last, 1, pixels + whole * kernel->period_image_bytes);
+    }
+}
+
+void lsb_extract(const LsbKernel *kernel, const unsigned char *pixels, long n, unsigned char *data)
+{
+    long whole = n / kernel->period_bytes;
+    long tail = n % kernel->period_bytes;
+
+    kernel->extract(pixels, whole, data);
+    if (tail)
+    {
+        unsigned char last[MAX_LSB_PERIOD_BYTES];
+        kernel->extract(pixels + whole * kernel->period_image_bytes, 1, last);
+        memcpy(data + whole * kernel->period_bytes, last, tail);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef LSB_H
+#define LSB_H
+
+#include "types.h"
+
+/* Largest period (data bytes) of any kernel instance */
+#define MAX_LSB_PERIOD_BYTES 3
+
+/*
+ * One specialised embed/extract kernel.
+ * Data is spread MSB first over the low 'bits' bits of every carrier
+ * channel. A period is the smallest run of whole pixels that holds a
+ * whole number of data bytes, kernels always work on whole periods.
+ */
+typedef struct _LsbKernel
+{
+    int bits;                 // Bits per channel: 1, 2 or 4
+    int bpp;                  // Bytes per pixel: 3 or 4 (any for a full mask)
+    uint channel_mask;        // Bit c set = channel c carries data
+    int period_bytes;         // Data bytes per period
+    int period_image_bytes;   // Image bytes per period
+
+    /* Embed / extract 'periods' whole periods */
+    void (*embed)(const unsigned char *data, long periods, unsigned char *pixels);
+    void (*extract)(const unsigned char *pixels, long periods, unsigned char *data);
+} LsbKernel;
+
+/* Number of partial mask kernel instances */
+int lsb_instance_count(void);
+
+/* Kernel of partial mask instance i, as lsb_select_kernel picks it for that layout */
+Status lsb_instance_kernel(int i, LsbKernel *kernel);
+
+/* Pick the kernel instance for this layout, once per image */
+Status lsb_select_kernel(int bits, int bpp, uint channel_mask, LsbKernel *kernel);
+
+/* Image bytes needed to carry 'data_bytes' bytes (rounded to whole periods) */
+long lsb_image_bytes_for(const LsbKernel *kernel, long data_bytes);
+
+/* Embed 'n' data bytes into pixels, which must hold lsb_image_bytes_for(n) bytes */
+void lsb_embed(const LsbKernel *kernel, const unsigned char *data, long n, unsigned char *pixels);
+
+/* Extract 'n' data bytes from pixels holding lsb_image_bytes_for(n) bytes */
+void lsb_extract(const LsbKernel *kernel, const unsigned char *pixels, long n, unsigned char *data);
+
+#endif
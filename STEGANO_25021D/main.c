@@ -3,24 +3,67 @@
 #include "encode.h"
 #include "decode.h"
 #include "types.h"
+#include "profile.h"
+#include "region.h"
+#include "cover.h"
+#include "fec.h"
+#include "update.h"
+#include "analyze.h"
+#include "verify.h"
 
 // Color codes for terminal output
 #define RED "\x1B[31m"
 #define GREEN "\x1B[32m"
 #define RESET "\x1B[0m"
 
-// Function to check operation type (-e for encode, -d for decode)
+// Function to check operation type (-e for encode, -d for decode, -l / -x for archives, -a to analyze)
 OperationType check_operation_type(char *symbol);
 
 int main(int argc, char *argv[])
 {
+    // Strip --profile / --profile=json, it may appear anywhere
+    argc = profile_parse_args(argc, argv);
+
+    // Strip --raw=<w>x<h>x<bpp> (geometry of .raw covers)
+    CoverGeometry raw_geometry;
+    argc = cover_parse_args(argc, argv, &raw_geometry);
+
+    // Strip --fec / --fec=<parity> (encoding only)
+    int fec_parity;
+    argc = fec_parse_args(argc, argv, &fec_parity);
+
+    // Strip --adaptive (encoding only)
+    AdaptiveMap adaptive;
+    argc = adaptive_parse_args(argc, argv, &adaptive);
+
+    // Strip --verify (check while encoding, or only check the digest when decoding)
+    int verify;
+    argc = verify_parse_args(argc, argv, &verify);
+
+    // Strip --analyze (check the stego image after encoding)
+    int analyze_check;
+    argc = analyze_parse_args(argc, argv, &analyze_check);
+
+    // Strip --channels= / --region= / --row-step= (encoding, or the analysed area)
+    EmbedRegion region;
+    argc = region_parse_args(argc, argv, &region);
+
     // Check if enough arguments are provided
     if (argc < 3)
     {
         // Display usage message
         printf("Usage:\n");
-        printf(RED"  Encoding: ./stego.out -e <src.bmp> <secret.txt> [output.bmp]\n"RESET);
-        printf(RED"  Decoding: ./stego.out -d <stego.bmp> [output_name]\n"RESET);
+        printf(RED"  Encoding: ./stego.out -e <cover> <secret.txt> [output]\n"RESET);
+        printf(RED"  Archive:  ./stego.out -e <cover> <file> <file>... [output]\n"RESET);
+        printf(RED"  Decoding: ./stego.out -d <stego> [output_name]\n"RESET);
+        printf(RED"  List:     ./stego.out -l <stego>\n"RESET);
+        printf(RED"  Extract:  ./stego.out -x <stego> <entry> [output]\n"RESET);
+        printf(RED"  Update:   ./stego.out -u <stego> <secret.txt>|<file>...\n"RESET);
+        printf(RED"  Analyze:  ./stego.out -a <image> [--channels=.. --region=..]\n"RESET);
+        printf("  Encoding options: --channels=<bgr> --region=<x,y,w,h> --row-step=<n> --fec[=<parity>] --adaptive --analyze --verify\n");
+        printf("  Decoding option: --verify checks the payload digest without writing output\n");
+        printf("  Covers: " COVER_SUFFIXES ", --raw=<w>x<h>x<bpp> gives .raw geometry\n");
+        printf("  Add --profile or --profile=json to print per-stage timings.\n");
         return 1;
     }
 
@@ -33,17 +76,40 @@ int main(int argc, char *argv[])
         case e_encode:
         {
             // Check argument count for encoding
-            if (argc >= 4 && argc <= 5)
+            if (argc >= 4)
             {
                 EncodeInfo encInfo;
+                encInfo.raw_geometry = raw_geometry;
+                encInfo.region = region;
+                encInfo.fec_parity = fec_parity;
+                encInfo.adaptive = adaptive;
+                encInfo.verify = verify;
 
                 // Validate encoding arguments
                 if (read_and_validate_encode_args(argv, &encInfo) == e_success)
                 {
                     // Perform encoding
                     if (do_encoding(&encInfo) == e_success)
+                    {
                         printf(GREEN "\nEncoding completed successfully: %s\n" RESET, 
                                encInfo.stego_image_fname);
+
+                        // Report how detectable the embedding is, next to the cover's own scores
+                        if (analyze_check)
+                        {
+                            AnalyzeInfo anaInfo;
+                            anaInfo.format = encInfo.src_format;
+                            anaInfo.raw_geometry = raw_geometry;
+                            anaInfo.region.enabled = 0;
+                            anaInfo.image_fname = encInfo.src_image_fname;
+                            printf("\n");
+                            do_analysis(&anaInfo);
+                            anaInfo.region.enabled = 0;
+                            anaInfo.image_fname = encInfo.stego_image_fname;
+                            printf("\n");
+                            do_analysis(&anaInfo);
+                        }
+                    }
                     else
                         printf(RED "\nERROR: Encoding failed!\n" RESET);
                 }
@@ -55,7 +121,7 @@ int main(int argc, char *argv[])
             else
             {
                 // Incorrect usage for encoding
-                printf(RED "Usage: ./stego.out -e <src.bmp> <secret.txt> [output.bmp]\n" RESET);
+                printf(RED "Usage: ./stego.out -e <cover> <secret.txt> [output]\n" RESET);
             }
             break;
         }
@@ -71,10 +137,13 @@ int main(int argc, char *argv[])
                 // Validate decoding arguments
                 if (read_and_validate_decode_args(argv, &decInfo) == e_success)
                 {
+                    decInfo.raw_geometry = raw_geometry;
+                    decInfo.verify_only = verify;
+
                     // Perform decoding
                     if (do_decoding(&decInfo) == e_success)
-                        printf(GREEN "\nDecoding completed successfully: %s\n" RESET, 
-                               decInfo.secret_fname);
+                        printf(GREEN "\nDecoding completed successfully: %s\n" RESET, decInfo.verify_only ? "payload verified" :
+                               decInfo.is_archive ? "all archive entries" : decInfo.secret_fname);
                     else
                         printf(RED "\nERROR: Decoding failed!\n" RESET);
                 }
@@ -86,7 +155,79 @@ int main(int argc, char *argv[])
             else
             {
                 // Incorrect usage for decoding
-                printf(RED "Usage: ./stego.out -d <stego.bmp> [output_name]\n" RESET);
+                printf(RED "Usage: ./stego.out -d <stego> [output_name]\n" RESET);
+            }
+            break;
+        }
+
+        // Archive listing / single entry extraction
+        case e_list:
+        case e_extract:
+        {
+            if ((op_type == e_list && argc == 3) || (op_type == e_extract && argc >= 4 && argc <= 5))
+            {
+                DecodeInfo decInfo;
+                ArchiveAction action = op_type == e_list ? e_archive_list : e_archive_extract_one;
+
+                if (read_and_validate_archive_args(argv, action, &decInfo) != e_success)
+                {
+                    printf(RED "\nERROR: Archive access failed!\n" RESET);
+                    break;
+                }
+                decInfo.raw_geometry = raw_geometry;
+                if (do_decoding(&decInfo) == e_success)
+                {
+                    if (op_type == e_extract)
+                        printf(GREEN "\nExtracted %s to %s\n" RESET, decInfo.entry_name, decInfo.entry_output);
+                }
+                else
+                {
+                    printf(RED "\nERROR: Archive access failed!\n" RESET);
+                }
+            }
+            else
+            {
+                printf(RED "Usage: ./stego.out -l <stego> | -x <stego> <entry> [output]\n" RESET);
+            }
+            break;
+        }
+
+        // Replace the payload of an existing stego image
+        case e_update:
+        {
+            if (argc >= 4)
+            {
+                UpdateInfo updInfo;
+                int valid = read_and_validate_update_args(argv, &updInfo) == e_success;
+
+                updInfo.decInfo.raw_geometry = raw_geometry;
+                if (valid && do_update(&updInfo) == e_success)
+                    printf(GREEN "\nUpdate completed successfully: %s\n" RESET, argv[2]);
+                else
+                    printf(RED "\nERROR: Update failed!\n" RESET);
+            }
+            else
+            {
+                printf(RED "Usage: ./stego.out -u <stego> <secret.txt>|<file>...\n" RESET);
+            }
+            break;
+        }
+
+        // Steganalysis report of an image
+        case e_analyze:
+        {
+            if (argc == 3)
+            {
+                AnalyzeInfo anaInfo;
+                anaInfo.raw_geometry = raw_geometry;
+                anaInfo.region = region;
+
+                if (read_and_validate_analyze_args(argv, &anaInfo) != e_success || do_analysis(&anaInfo) != e_success)
+                    printf(RED "\nERROR: Analysis failed!\n" RESET);
+            }
+            else
+            {
+                printf(RED "Usage: ./stego.out -a <image> [--channels=<bgr>] [--region=<x,y,w,h>]\n" RESET);
             }
             break;
         }
@@ -94,10 +235,11 @@ int main(int argc, char *argv[])
         // Unsupported operation type
         default:
             printf(RED "ERROR: Unsupported operation: %s\n" RESET, argv[1]);
-            printf("Use -e for encoding or -d for decoding.\n");
+            printf("Use -e for encoding, -d for decoding, -l / -x for archives, -u to update, -a to analyze.\n");
             break;
     }
 
+    profile_report();
     return 0;
 }
 
@@ -108,6 +250,14 @@ OperationType check_operation_type(char *symbol)
         return e_encode;        // Encoding
     else if (strcmp(symbol, "-d") == 0)
         return e_decode;        // Decoding
+    else if (strcmp(symbol, "-l") == 0)
+        return e_list;          // List archive entries
+    else if (strcmp(symbol, "-x") == 0)
+        return e_extract;       // Extract one archive entry
+    else if (strcmp(symbol, "-u") == 0)
+        return e_update;        // Update the payload in place
+    else if (strcmp(symbol, "-a") == 0)
+        return e_analyze;       // Steganalysis report
     else
         return e_unsupported;   // Invalid option
 }
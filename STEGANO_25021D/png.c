@@ -0,0 +1,452 @@
+/*
+PNG cover format.
+8-bit, non-interlaced RGB and RGBA images. Scanlines are inflated and
+unfiltered one row at a time as the pixel stream is read, and on the
+writing side every completed row is re-filtered and deflated straight
+into IDAT chunks, so memory stays bounded to a few rows whatever the
+image size. The pixel stream is the unfiltered scanline data without the
+filter bytes, which keeps payload offsets independent of how the encoder
+chose to filter. Chunks before and after the image data are copied as is.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "cover.h"
+
+#define PNG_IO_CHUNK 65536   // Compressed bytes per read / per IDAT chunk
+#define PNG_MAX_RATIO 1032   // Largest deflate expansion, bounds the pixels a file can hold
+
+/* A row and its filter byte go through zlib in one piece, counted in uInt */
+#define PNG_MAX_ROW_BYTES ((long)(uInt)-1 - 1)
+
+static const unsigned char png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+typedef struct _PngState
+{
+    z_stream zs;
+    int zs_ready;            // inflate/deflate initialised
+    int writing;
+    long idat_offset;        // File offset of the first IDAT chunk (reader)
+    unsigned long chunk_left; // Bytes left in the current IDAT chunk (reader)
+    unsigned char *io;       // Compressed data buffer
+    unsigned char *prev;     // Previous unfiltered row
+    unsigned char *row;      // Current unfiltered row
+    unsigned char *filtered; // Reader: one raw row, writer: 5 candidate rows
+    long row_bytes;
+    long row_pos;            // Offset inside the current row
+    uint rows_done;
+} PngState;
+
+static uint get_be32(const unsigned char *p)
+{
+    return ((uint)p[0] << 24) | ((uint)p[1] << 16) | ((uint)p[2] << 8) | p[3];
+}
+
+static void put_be32(unsigned char *p, uint v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+static Status png_alloc_state(Cover *cover, int writing)
+{
+    PngState *st = calloc(1, sizeof(PngState));
+    if (st == NULL)
+        return e_failure;
+
+    st->writing = writing;
+    st->row_bytes = cover->stride;
+    st->row_pos = writing ? 0 : st->row_bytes;
+    st->io = malloc(PNG_IO_CHUNK);
+    st->prev = calloc(1, st->row_bytes);
+    st->row = calloc(1, st->row_bytes);
+    st->filtered = malloc((st->row_bytes + 1) * (writing ? 5 : 1));
+    cover->state = st;
+
+    if (!st->io || !st->prev || !st->row || !st->filtered)
+        return e_failure;
+
+    int ret = writing ? deflateInit(&st->zs, Z_DEFAULT_COMPRESSION) : inflateInit(&st->zs);
+    if (ret != Z_OK)
+        return e_failure;
+    st->zs_ready = 1;
+    return e_success;
+}
+
+/* Parse IHDR and stop at the first IDAT */
+static Status png_read_header(Cover *cover)
+{
+    unsigned char sig[8], hdr[8], ihdr[13];
+
+    rewind(cover->fptr);
+    if (fread(sig, 1, 8, cover->fptr) != 8 || memcmp(sig, png_signature, 8) != 0 ||
+        fread(hdr, 1, 8, cover->fptr) != 8 || memcmp(hdr + 4, "IHDR", 4) != 0 ||
+        get_be32(hdr) != 13 || fread(ihdr, 1, 13, cover->fptr) != 13)
+    {
+        return e_failure;
+    }
+
+    uint width = get_be32(ihdr), height = get_be32(ihdr + 4);
+    int depth = ihdr[8], color_type = ihdr[9], interlace = ihdr[12];
+    int bpp = color_type == 2 ? 3 : 4;
+    if (depth != 8 || (color_type != 2 && color_type != 6) || interlace != 0 ||
+        width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF ||
+        (long)width * bpp > PNG_MAX_ROW_BYTES)
+    {
+        return e_failure;
+    }
+
+    cover->width = width;
+    cover->height = height;
+    cover->bottom_up = 0;
+    cover->bpp = bpp;
+    cover->channels = color_type == 2 ? "rgb" : "rgba";
+    cover->stride = (long)width * cover->bpp;
+    cover->pixel_bytes = cover->stride * height;
+
+    // Reject dimensions no file of this size can inflate to, before anything sizes a buffer by them
+    long ihdr_end = ftell(cover->fptr);
+    fseek(cover->fptr, 0, SEEK_END);
+    if ((cover->pixel_bytes + height) / PNG_MAX_RATIO > ftell(cover->fptr))
+    {
+        return e_failure;
+    }
+    fseek(cover->fptr, ihdr_end, SEEK_SET);
+
+    // Skip IHDR CRC and any chunk up to the first IDAT
+    fseek(cover->fptr, 4, SEEK_CUR);
+    for (;;)
+    {
+        if (fread(hdr, 1, 8, cover->fptr) != 8 || memcmp(hdr + 4, "IEND", 4) == 0)
+            return e_failure;
+        if (memcmp(hdr + 4, "IDAT", 4) == 0)
+            break;
+        fseek(cover->fptr, get_be32(hdr) + 4L, SEEK_CUR);
+    }
+
+    if (png_alloc_state(cover, 0) != e_success)
+        return e_failure;
+
+    PngState *st = cover->state;
+    st->idat_offset = ftell(cover->fptr) - 8;
+    st->chunk_left = get_be32(hdr);
+    return e_success;
+}
+
+/* Feed the inflater from the IDAT chunks */
+static Status png_fill_input(Cover *cover, PngState *st)
+{
+    unsigned char hdr[8];
+
+    // chunk_left == 0 means the CRC of the current IDAT is next
+    while (st->chunk_left == 0)
+    {
+        if (fseek(cover->fptr, 4, SEEK_CUR) != 0 || fread(hdr, 1, 8, cover->fptr) != 8 ||
+            memcmp(hdr + 4, "IDAT", 4) != 0)
+        {
+            return e_failure;
+        }
+        st->chunk_left = get_be32(hdr);
+    }
+
+    long n = st->chunk_left < PNG_IO_CHUNK ? (long)st->chunk_left : PNG_IO_CHUNK;
+    if (fread(st->io, 1, n, cover->fptr) != (size_t)n)
+        return e_failure;
+    st->chunk_left -= n;
+    st->zs.next_in = st->io;
+    st->zs.avail_in = n;
+    return e_success;
+}
+
+/* Inflate and unfilter the next scanline into st->row */
+static Status png_next_row(Cover *cover, PngState *st)
+{
+    unsigned char *tmp = st->prev;
+    st->prev = st->row;
+    st->row = tmp;
+
+    st->zs.next_out = st->filtered;
+    st->zs.avail_out = st->row_bytes + 1;
+    while (st->zs.avail_out > 0)
+    {
+        if (st->zs.avail_in == 0 && png_fill_input(cover, st) != e_success)
+            return e_failure;
+        int ret = inflate(&st->zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END && st->zs.avail_out > 0)
+            return e_failure;
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+            return e_failure;
+    }
+
+    int bpp = cover->bpp;
+    const unsigned char *in = st->filtered + 1;
+    unsigned char *out = st->row, *up = st->prev;
+    for (long i = 0; i < st->row_bytes; i++)
+    {
+        int a = i >= bpp ? out[i - bpp] : 0;
+        int c = i >= bpp ? up[i - bpp] : 0;
+        switch (st->filtered[0])
+        {
+            case 0: out[i] = in[i]; break;
+            case 1: out[i] = in[i] + a; break;
+            case 2: out[i] = in[i] + up[i]; break;
+            case 3: out[i] = in[i] + ((a + up[i]) >> 1); break;
+            case 4: out[i] = in[i] + paeth(a, up[i], c); break;
+            default: return e_failure;
+        }
+    }
+
+    st->row_pos = 0;
+    st->rows_done++;
+    return e_success;
+}
+
+static long png_read(Cover *cover, unsigned char *buf, long n)
+{
+    PngState *st = cover->state;
+    long done = 0;
+
+    while (done < n)
+    {
+        if (st->row_pos == st->row_bytes && png_next_row(cover, st) != e_success)
+            break;
+        long chunk = st->row_bytes - st->row_pos;
+        if (chunk > n - done)
+            chunk = n - done;
+        memcpy(buf + done, st->row + st->row_pos, chunk);
+        st->row_pos += chunk;
+        done += chunk;
+    }
+    return done;
+}
+
+static void png_release(Cover *cover);
+
+/* Rows are skipped without copying, seeking back restarts the inflate stream */
+static Status png_seek(Cover *cover, long offset)
+{
+    long skip = offset - cover->pos;
+
+    if (skip < 0)
+    {
+        png_release(cover);
+        cover->state = NULL;
+        if (png_read_header(cover) != e_success)
+            return e_failure;
+        skip = offset;
+    }
+
+    PngState *st = cover->state;
+    while (skip > 0)
+    {
+        if (st->row_pos == st->row_bytes && png_next_row(cover, st) != e_success)
+            return e_failure;
+        long chunk = st->row_bytes - st->row_pos;
+        if (chunk > skip)
+            chunk = skip;
+        st->row_pos += chunk;
+        skip -= chunk;
+    }
+    return e_success;
+}
+
+static Status png_write_chunk(FILE *fptr, const char *type, const unsigned char *data, uint len)
+{
+    unsigned char hdr[8], crc_bytes[4];
+
+    put_be32(hdr, len);
+    memcpy(hdr + 4, type, 4);
+    uLong crc = crc32(0L, hdr + 4, 4);
+    crc = crc32(crc, data, len);
+    put_be32(crc_bytes, crc);
+
+    if (fwrite(hdr, 1, 8, fptr) != 8 || fwrite(data, 1, len, fptr) != len ||
+        fwrite(crc_bytes, 1, 4, fptr) != 4)
+    {
+        return e_failure;
+    }
+    return e_success;
+}
+
+/* Signature, IHDR and every chunk before the image data are copied from src */
+static Status png_write_header(Cover *dest, Cover *src)
+{
+    PngState *src_st = src->state;
+    long resume = ftell(src->fptr);
+    unsigned char buffer[4096];
+    long left = src_st->idat_offset;
+
+    rewind(src->fptr);
+    while (left > 0)
+    {
+        long chunk = left < (long)sizeof(buffer) ? left : (long)sizeof(buffer);
+        if (fread(buffer, 1, chunk, src->fptr) != (size_t)chunk ||
+            fwrite(buffer, 1, chunk, dest->fptr) != (size_t)chunk)
+        {
+            return e_failure;
+        }
+        left -= chunk;
+    }
+    fseek(src->fptr, resume, SEEK_SET);
+
+    if (png_alloc_state(dest, 1) != e_success)
+        return e_failure;
+    PngState *st = dest->state;
+    st->zs.next_out = st->io;
+    st->zs.avail_out = PNG_IO_CHUNK;
+    return e_success;
+}
+
+/* Run the deflater, emitting an IDAT each time the buffer fills */
+static Status png_deflate(Cover *cover, PngState *st, int flush)
+{
+    int ret;
+    do
+    {
+        ret = deflate(&st->zs, flush);
+        if (ret == Z_STREAM_ERROR)
+            return e_failure;
+        if (st->zs.avail_out == 0 || (flush == Z_FINISH && st->zs.avail_out < PNG_IO_CHUNK))
+        {
+            if (png_write_chunk(cover->fptr, "IDAT", st->io, PNG_IO_CHUNK - st->zs.avail_out) != e_success)
+                return e_failure;
+            st->zs.next_out = st->io;
+            st->zs.avail_out = PNG_IO_CHUNK;
+        }
+    } while (st->zs.avail_in > 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    return e_success;
+}
+
+/* Filter a finished row with the smallest-sum heuristic and deflate it */
+static Status png_flush_row(Cover *cover, PngState *st)
+{
+    int bpp = cover->bpp;
+    long n = st->row_bytes;
+    const unsigned char *cur = st->row, *up = st->prev;
+    unsigned char *best = NULL;
+    unsigned long best_sum = (unsigned long)-1;
+
+    for (int type = 0; type < 5; type++)
+    {
+        unsigned char *f = st->filtered + type * (n + 1);
+        unsigned long sum = 0;
+        f[0] = type;
+        for (long i = 0; i < n; i++)
+        {
+            int a = i >= bpp ? cur[i - bpp] : 0;
+            int c = i >= bpp ? up[i - bpp] : 0;
+            unsigned char v;
+            switch (type)
+            {
+                case 0: v = cur[i]; break;
+                case 1: v = cur[i] - a; break;
+                case 2: v = cur[i] - up[i]; break;
+                case 3: v = cur[i] - ((a + up[i]) >> 1); break;
+                default: v = cur[i] - paeth(a, up[i], c); break;
+            }
+            f[i + 1] = v;
+            sum += v < 128 ? v : 256 - v;
+        }
+        if (sum < best_sum)
+        {
+            best_sum = sum;
+            best = f;
+        }
+    }
+
+    st->zs.next_in = best;
+    st->zs.avail_in = n + 1;
+    if (png_deflate(cover, st, Z_NO_FLUSH) != e_success)
+        return e_failure;
+
+    unsigned char *tmp = st->prev;
+    st->prev = st->row;
+    st->row = tmp;
+    st->row_pos = 0;
+    st->rows_done++;
+    return e_success;
+}
+
+static Status png_write(Cover *cover, const unsigned char *buf, long n)
+{
+    PngState *st = cover->state;
+
+    while (n > 0)
+    {
+        long chunk = st->row_bytes - st->row_pos;
+        if (chunk > n)
+            chunk = n;
+        memcpy(st->row + st->row_pos, buf, chunk);
+        st->row_pos += chunk;
+        buf += chunk;
+        n -= chunk;
+        if (st->row_pos == st->row_bytes && png_flush_row(cover, st) != e_success)
+            return e_failure;
+    }
+    return e_success;
+}
+
+/* Close the zlib stream, then copy the chunks that follow the image data */
+static Status png_finish(Cover *dest, Cover *src)
+{
+    PngState *st = dest->state;
+    PngState *src_st = src->state;
+    unsigned char hdr[8];
+    char buffer[4096];
+    size_t n;
+
+    if (png_deflate(dest, st, Z_FINISH) != e_success)
+        return e_failure;
+
+    // Skip the rest of the source image data
+    fseek(src->fptr, src_st->chunk_left + 4L, SEEK_CUR);
+    while (fread(hdr, 1, 8, src->fptr) == 8 && memcmp(hdr + 4, "IDAT", 4) == 0)
+        fseek(src->fptr, get_be32(hdr) + 4L, SEEK_CUR);
+    fseek(src->fptr, -8L, SEEK_CUR);
+
+    while ((n = fread(buffer, 1, sizeof(buffer), src->fptr)) > 0)
+    {
+        if (fwrite(buffer, 1, n, dest->fptr) != n)
+            return e_failure;
+    }
+    return e_success;
+}
+
+static void png_release(Cover *cover)
+{
+    PngState *st = cover->state;
+    if (st == NULL)
+        return;
+    if (st->zs_ready)
+    {
+        if (st->writing)
+            deflateEnd(&st->zs);
+        else
+            inflateEnd(&st->zs);
+    }
+    free(st->io);
+    free(st->prev);
+    free(st->row);
+    free(st->filtered);
+    free(st);
+}
+
+const CoverFormat png_format = {
+    "PNG", ".png", "stego.png", 0,
+    png_read_header, png_write_header,
+    png_read, png_write, png_seek,
+    png_finish, png_release
+};
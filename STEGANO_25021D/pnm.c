@@ -0,0 +1,96 @@
+/*
+Binary PPM (P6) and PGM (P5) cover formats.
+8-bit samples only (maxval 255). The pixel stream is everything after
+the single whitespace byte that ends the text header, rows top-down.
+*/
+
+#include <stdio.h>
+#include <ctype.h>
+#include "cover.h"
+
+/* Read one header number, skipping whitespace and # comments */
+static Status pnm_read_number(FILE *fptr, uint *value)
+{
+    int c = fgetc(fptr);
+
+    for (;;)
+    {
+        if (c == '#')
+        {
+            while (c != '\n' && c != EOF)
+                c = fgetc(fptr);
+        }
+        else if (isspace(c))
+        {
+            c = fgetc(fptr);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (!isdigit(c))
+        return e_failure;
+
+    *value = 0;
+    while (isdigit(c))
+    {
+        if (*value > 0xFFFFFF)
+            return e_failure;
+        *value = *value * 10 + (c - '0');
+        c = fgetc(fptr);
+    }
+
+    // Exactly one whitespace byte ends each number
+    return isspace(c) ? e_success : e_failure;
+}
+
+static Status pnm_read_header(Cover *cover, char magic, int bpp, const char *channels)
+{
+    uint width, height, maxval;
+
+    rewind(cover->fptr);
+    if (fgetc(cover->fptr) != 'P' || fgetc(cover->fptr) != magic ||
+        pnm_read_number(cover->fptr, &width) != e_success ||
+        pnm_read_number(cover->fptr, &height) != e_success ||
+        pnm_read_number(cover->fptr, &maxval) != e_success ||
+        width == 0 || height == 0 || maxval != 255)
+    {
+        return e_failure;
+    }
+
+    cover->width = width;
+    cover->height = height;
+    cover->bottom_up = 0;
+    cover->bpp = bpp;
+    cover->channels = channels;
+    cover->stride = (long)width * bpp;
+    cover->pixel_bytes = cover->stride * height;
+
+    return plain_cover_init(cover, ftell(cover->fptr));
+}
+
+static Status ppm_read_header(Cover *cover)
+{
+    return pnm_read_header(cover, '6', 3, "rgb");
+}
+
+static Status pgm_read_header(Cover *cover)
+{
+    return pnm_read_header(cover, '5', 1, "y");
+}
+
+const CoverFormat ppm_format = {
+    "PPM", ".ppm", "stego.ppm", 1,
+    ppm_read_header, plain_write_header,
+    plain_read, plain_write, plain_seek,
+    plain_finish, plain_release
+};
+
+const CoverFormat pgm_format = {
+    "PGM", ".pgm", "stego.pgm", 1,
+    pgm_read_header, plain_write_header,
+    plain_read, plain_write, plain_seek,
+    plain_finish, plain_release
+};
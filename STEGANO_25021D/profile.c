@@ -0,0 +1,184 @@
+/*
+Per-stage profiling for encoding and decoding.
+Enabled by passing --profile (table) or --profile=json on the command line.
+Each stage records wall time, image bytes processed and, where the kernel
+permits perf_event_open, cycles, instructions and cache misses. The
+counters are inherited by the worker threads of the adaptive map and the
+analysis report, so their work is counted in the stage that started them.
+When profiling is off every call returns immediately.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "profile.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static ProfileMode profile_mode = e_profile_off;
+static StageProfile stages[MAX_PROFILE_STAGES];
+static int stage_count = 0;
+
+#define HW_COUNTERS 3
+
+/* State of the stage currently being timed */
+static struct timespec stage_start;
+static long stage_start_offset;
+static int perf_fds[HW_COUNTERS] = {-1, -1, -1};   // -1 when counters are unavailable
+static unsigned long long stage_start_counts[HW_COUNTERS];
+static int stage_start_valid;
+
+/*
+ * Open cycles/instructions/cache-miss counters for this thread and every
+ * thread it starts later. Inherited counters cannot be read as a group,
+ * so each has its own fd; they run all the time and a stage is the
+ * difference between two reads (a reset would not clear what exited
+ * threads already added).
+ */
+static void open_hw_counters(void)
+{
+#ifdef __linux__
+    unsigned long long configs[HW_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    for (int i = 0; i < HW_COUNTERS; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        perf_fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (perf_fds[i] < 0)
+        {
+            // Not permitted (perf_event_paranoid) or not supported
+            for (int j = 0; j < i; j++)
+            {
+                close(perf_fds[j]);
+                perf_fds[j] = -1;
+            }
+            perf_fds[i] = -1;
+            return;
+        }
+    }
+#endif
+}
+
+/* Current value of every counter, 0 if they are unavailable or a read fails */
+static int read_hw_counters(unsigned long long *counts)
+{
+#ifdef __linux__
+    if (perf_fds[0] < 0)
+        return 0;
+    for (int i = 0; i < HW_COUNTERS; i++)
+    {
+        if (read(perf_fds[i], &counts[i], sizeof(counts[i])) != sizeof(counts[i]))
+            return 0;
+    }
+    return 1;
+#else
+    (void)counts;
+    return 0;
+#endif
+}
+
+int profile_parse_args(int argc, char *argv[])
+{
+    int j = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--profile") == 0)
+            profile_mode = e_profile_table;
+        else if (strcmp(argv[i], "--profile=json") == 0)
+            profile_mode = e_profile_json;
+        else
+            argv[j++] = argv[i];
+    }
+    argv[j] = NULL;
+
+    if (profile_mode != e_profile_off)
+        open_hw_counters();
+
+    return j;
+}
+
+void profile_begin(const char *name, const long *pos)
+{
+    if (profile_mode == e_profile_off || stage_count == MAX_PROFILE_STAGES)
+        return;
+
+    stages[stage_count].name = name;
+    stage_start_offset = pos ? *pos : 0;
+
+    stage_start_valid = read_hw_counters(stage_start_counts);
+    clock_gettime(CLOCK_MONOTONIC, &stage_start);
+}
+
+void profile_end(const long *pos)
+{
+    struct timespec stage_stop;
+
+    if (profile_mode == e_profile_off || stage_count == MAX_PROFILE_STAGES)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &stage_stop);
+    StageProfile *stage = &stages[stage_count++];
+
+    unsigned long long counts[HW_COUNTERS];
+    if (stage_start_valid && read_hw_counters(counts))
+    {
+        stage->cycles = counts[0] - stage_start_counts[0];
+        stage->instructions = counts[1] - stage_start_counts[1];
+        stage->cache_misses = counts[2] - stage_start_counts[2];
+        stage->hw_valid = 1;
+    }
+
+    stage->wall_us = (stage_stop.tv_sec - stage_start.tv_sec) * 1e6 +
+                     (stage_stop.tv_nsec - stage_start.tv_nsec) / 1e3;
+    stage->bytes = pos ? *pos - stage_start_offset : 0;
+}
+
+void profile_report(void)
+{
+    if (profile_mode == e_profile_json)
+    {
+        printf("{\"stages\": [");
+        for (int i = 0; i < stage_count; i++)
+        {
+            StageProfile *s = &stages[i];
+            printf("%s\n  {\"name\": \"%s\", \"wall_us\": %.3f, \"bytes\": %ld",
+                   i ? "," : "", s->name, s->wall_us, s->bytes);
+            if (s->hw_valid)
+                printf(", \"cycles\": %lld, \"instructions\": %lld, \"cache_misses\": %lld",
+                       s->cycles, s->instructions, s->cache_misses);
+            printf("}");
+        }
+        printf("\n]}\n");
+    }
+    else if (profile_mode == e_profile_table)
+    {
+        printf("\n%-32s %12s %12s %14s %14s %12s\n",
+               "stage", "wall(us)", "bytes", "cycles", "instructions", "cache-miss");
+        for (int i = 0; i < stage_count; i++)
+        {
+            StageProfile *s = &stages[i];
+            if (s->hw_valid)
+                printf("%-32s %12.3f %12ld %14lld %14lld %12lld\n", s->name, s->wall_us,
+                       s->bytes, s->cycles, s->instructions, s->cache_misses);
+            else
+                printf("%-32s %12.3f %12ld %14s %14s %12s\n", s->name, s->wall_us,
+                       s->bytes, "n/a", "n/a", "n/a");
+        }
+    }
+}
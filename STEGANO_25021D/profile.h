@@ -0,0 +1,44 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include "types.h"
+
+/* Maximum number of stages recorded in one run */
+#define MAX_PROFILE_STAGES 32
+
+/*
+ * Timing and hardware counters of one encode/decode stage.
+ * Bytes are the pixel stream bytes the stage advanced through.
+ */
+typedef struct _StageProfile
+{
+    const char *name;            // Stage (function) name
+    double wall_us;              // Wall time in microseconds
+    long bytes;                  // Image bytes processed
+    long long cycles;            // CPU cycles (if hw_valid)
+    long long instructions;      // Retired instructions (if hw_valid)
+    long long cache_misses;      // Cache misses (if hw_valid)
+    int hw_valid;                // Hardware counters could be read
+} StageProfile;
+
+typedef enum
+{
+    e_profile_off,
+    e_profile_table,
+    e_profile_json
+} ProfileMode;
+
+/* Parse and strip --profile / --profile=json from argv, returns new argc */
+int profile_parse_args(int argc, char *argv[]);
+
+/* Start timing a stage, pos (may be NULL) is the pixel stream offset used to count bytes */
+void profile_begin(const char *name, const long *pos);
+
+/* Stop timing the stage started by profile_begin */
+void profile_end(const long *pos);
+
+/* Print the summary table or JSON of all recorded stages */
+void profile_report(void);
+
+#endif
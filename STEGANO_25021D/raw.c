@@ -0,0 +1,72 @@
+/*
+Raw headerless cover format.
+Without --raw=<w>x<h>x<bpp> the whole file is one flat stream of bytes.
+With it, the file is read as top-down rows of w pixels of bpp bytes,
+which enables channel/region selection, and bytes past w*h*bpp are
+copied unchanged.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cover.h"
+
+int cover_parse_args(int argc, char *argv[], CoverGeometry *geometry)
+{
+    int j = 0;
+
+    memset(geometry, 0, sizeof(*geometry));
+    for (int i = 0; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--raw=", 6) == 0)
+        {
+            if (sscanf(argv[i] + 6, "%ux%ux%d", &geometry->width, &geometry->height, &geometry->bpp) != 3)
+                geometry->bpp = -1;                // rejected by raw_read_header
+        }
+        else
+        {
+            argv[j++] = argv[i];
+        }
+    }
+    argv[j] = NULL;
+    return j;
+}
+
+static Status raw_read_header(Cover *cover)
+{
+    static const char *channels[] = {"", "y", "ya", "rgb", "rgba"};
+    const CoverGeometry *raw = &cover->geometry;
+
+    if (raw->bpp == 0)
+    {
+        // No geometry: a single row of single byte pixels
+        fseek(cover->fptr, 0, SEEK_END);
+        cover->width = ftell(cover->fptr);
+        cover->height = 1;
+        cover->bpp = 1;
+    }
+    else if (raw->bpp >= 1 && raw->bpp <= 4 && raw->width > 0 && raw->height > 0)
+    {
+        cover->width = raw->width;
+        cover->height = raw->height;
+        cover->bpp = raw->bpp;
+    }
+    else
+    {
+        return e_failure;
+    }
+
+    cover->bottom_up = 0;
+    cover->channels = channels[cover->bpp];
+    cover->stride = (long)cover->width * cover->bpp;
+    cover->pixel_bytes = cover->stride * cover->height;
+
+    return plain_cover_init(cover, 0);
+}
+
+const CoverFormat raw_format = {
+    "RAW", ".raw", "stego.raw", 1,
+    raw_read_header, plain_write_header,
+    plain_read, plain_write, plain_seek,
+    plain_finish, plain_release
+};
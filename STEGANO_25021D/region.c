@@ -0,0 +1,150 @@
+/*
+Channel/region selective embedding.
+From the user's channel mask, rectangle and row step we build a compact
+index of embeddable runs (offset, length) once per image. Encoding and
+decoding then stream over those runs only, so the work depends on the
+payload size rather than the image size. Runs are kept in file order so
+the encoder can copy the cover forward in a single pass.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "region.h"
+
+#define RED "\x1B[31m"
+#define RESET "\x1B[0m"
+
+int region_parse_args(int argc, char *argv[], EmbedRegion *region)
+{
+    int j = 0;
+
+    memset(region, 0, sizeof(*region));
+    strcpy(region->channels, "bgr");
+    region->row_step = 1;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--channels=", 11) == 0)
+        {
+            region->enabled = 1;
+            if (strlen(argv[i] + 11) < sizeof(region->channels))
+                strcpy(region->channels, argv[i] + 11);
+            else
+                region->channels[0] = '\0';        // rejected by cover_channel_mask
+        }
+        else if (strncmp(argv[i], "--region=", 9) == 0)
+        {
+            region->enabled = 1;
+            if (sscanf(argv[i] + 9, "%u,%u,%u,%u", &region->x, &region->y,
+                       &region->width, &region->height) != 4)
+            {
+                region->row_step = 0;              // rejected by validate_region
+            }
+        }
+        else if (strncmp(argv[i], "--row-step=", 11) == 0)
+        {
+            region->enabled = 1;
+            region->row_step = atoi(argv[i] + 11);
+        }
+        else
+        {
+            argv[j++] = argv[i];
+        }
+    }
+    argv[j] = NULL;
+    return j;
+}
+
+Status validate_region(EmbedRegion *region, const Cover *cover)
+{
+    uint img_width = cover->width;
+    uint img_height = cover->height;
+
+    if (region->channel_mask == 0 || region->channel_mask >= (1u << cover->bpp))
+    {
+        fprintf(stderr, RED "ERROR: Channels must be letters of \"%s\"\n" RESET, cover->channels);
+        return e_failure;
+    }
+    if (region->row_step == 0)
+    {
+        fprintf(stderr, RED "ERROR: Region must be x,y,w,h and row step at least 1\n" RESET);
+        return e_failure;
+    }
+    if (region->x >= img_width || region->y >= img_height)
+    {
+        fprintf(stderr, RED "ERROR: Region starts outside the image\n" RESET);
+        return e_failure;
+    }
+
+    if (region->width == 0)
+        region->width = img_width - region->x;
+    if (region->height == 0)
+        region->height = img_height - region->y;
+
+    if (region->width > img_width - region->x || region->height > img_height - region->y)
+    {
+        fprintf(stderr, RED "ERROR: Region does not fit in the %ux%u image\n" RESET, img_width, img_height);
+        return e_failure;
+    }
+    return e_success;
+}
+
+long run_payload_bytes(const EmbedRun *run, const LsbKernel *kernel)
+{
+    return (run->length / kernel->period_image_bytes) * kernel->period_bytes;
+}
+
+Status build_run_index(const EmbedRegion *region, const Cover *cover,
+                       long data_start, const LsbKernel *kernel, RunIndex *index)
+{
+    int bottom_up = cover->bottom_up;
+    uint rows = cover->height;
+    long stride = cover->stride;
+    int bpp = cover->bpp;
+
+    index->runs = malloc(sizeof(EmbedRun) * (region->height / region->row_step + 1));
+    if (index->runs == NULL)
+        return e_failure;
+    index->count = 0;
+    index->max_length = 0;
+    index->capacity = 0;
+
+    // Walk rows in file order so runs come out with ascending offsets
+    for (uint file_row = 0; file_row < rows; file_row++)
+    {
+        uint row = bottom_up ? rows - 1 - file_row : file_row;
+        if (row < region->y || row >= region->y + region->height ||
+            (row - region->y) % region->row_step != 0)
+        {
+            continue;
+        }
+
+        EmbedRun run;
+        run.offset = file_row * stride + (long)region->x * bpp;
+        run.length = (long)region->width * bpp;
+
+        // Never overlap the header, trim to the first whole pixel after it
+        if (run.offset < data_start)
+        {
+            long trim = (data_start - run.offset + bpp - 1) / bpp * bpp;
+            run.offset += trim;
+            run.length -= trim;
+        }
+        if (run.length <= 0 || run_payload_bytes(&run, kernel) == 0)
+            continue;
+
+        index->runs[index->count++] = run;
+        index->capacity += run_payload_bytes(&run, kernel);
+        if (run.length > index->max_length)
+            index->max_length = run.length;
+    }
+    return e_success;
+}
+
+void free_run_index(RunIndex *index)
+{
+    free(index->runs);
+    index->runs = NULL;
+    index->count = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stdio.h>
+#include "types.h"
+#include "lsb.h"
+#include "cover.h"
+
+/*
+ * Channel/region restriction for the payload.
+ * The rectangle is in pixels with y counted from the top row,
+ * only every row_step-th row of it carries data.
+ */
+typedef struct _EmbedRegion
+{
+    int enabled;            // 0 = embed into every byte (flat layout)
+    char channels[5];       // Channel letters from --channels, e.g. "gr"
+    uint channel_mask;      // Bit c = channel c of the pixel in memory order
+    uint x, y;              // Top left corner of the rectangle
+    uint width, height;     // Rectangle size, 0 = up to the image edge
+    uint row_step;          // Use every row_step-th row
+} EmbedRegion;
+
+/* One contiguous span of embeddable pixel bytes */
+typedef struct _EmbedRun
+{
+    long offset;            // Offset in the pixel stream
+    long length;            // Length in bytes, whole pixels
+} EmbedRun;
+
+/* Runs of one region, built once per image */
+typedef struct _RunIndex
+{
+    EmbedRun *runs;
+    long count;
+    long max_length;        // Longest run, sizes the I/O buffer
+    long capacity;          // Payload bytes the runs can hold
+} RunIndex;
+
+/* Parse and strip --channels= / --region= / --row-step= from argv, returns new argc */
+int region_parse_args(int argc, char *argv[], EmbedRegion *region);
+
+/* Check the region against the cover and fill in defaulted width/height */
+Status validate_region(EmbedRegion *region, const Cover *cover);
+
+/*
+ * Build the run index for a region. Runs start at or after data_start
+ * (pixel stream offset where the payload begins, i.e. after the header).
+ */
+Status build_run_index(const EmbedRegion *region, const Cover *cover,
+                       long data_start, const LsbKernel *kernel, RunIndex *index);
+
+/* Payload bytes that fit in 'run' with 'kernel' */
+long run_payload_bytes(const EmbedRun *run, const LsbKernel *kernel);
+
+/* Release the runs of an index */
+void free_run_index(RunIndex *index);
+
+#endif
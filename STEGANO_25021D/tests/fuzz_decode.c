@@ -0,0 +1,161 @@
+/*
+Fuzz target for the decoder.
+The first input byte picks the cover format, the rest is the image file,
+opened from memory with fmemopen. The stego header is decoded, then the
+payload (or the archive index) is extracted, with the same cleanup as
+do_decoding. Nothing is written to disk.
+
+Built with -fsanitize=fuzzer this is a libFuzzer target. Built with
+-DFUZZ_STANDALONE it runs every file given on the command line, then
+a number of random mutations of each:
+    fuzz_decode [-n mutations] [-s seed] file...
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../decode.h"
+
+/* Same order as the formats of test_roundtrip */
+static const char *fuzz_names[] = {"f.bmp", "f.png", "f.ppm", "f.pgm", "f.tga", "f.raw"};
+#define FUZZ_FORMATS (sizeof(fuzz_names) / sizeof(fuzz_names[0]))
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static int quiet = 0;
+    if (!quiet)
+    {
+        // The decoder reports every step on stdout
+        quiet = freopen("/dev/null", "w", stdout) != NULL;
+    }
+    if (size < 2)
+        return 0;
+
+    DecodeInfo decInfo;
+    char *argv[] = {"fuzz", "-d", (char *)fuzz_names[data[0] % FUZZ_FORMATS], NULL};
+    if (read_and_validate_decode_args(argv, &decInfo) != e_success)
+        return 0;
+
+    decInfo.fptr_stego_image = fmemopen((void *)(data + 1), size - 1, "rb");
+    if (decInfo.fptr_stego_image == NULL)
+        return 0;
+    memset(&decInfo.stego_cover, 0, sizeof(decInfo.stego_cover));
+
+    if (decode_stego_header(&decInfo) == e_success)
+    {
+        if (decInfo.is_archive)
+        {
+            decInfo.archive_action = e_archive_list;
+            decode_archive(&decInfo);
+        }
+        else
+        {
+            unsigned char *payload = malloc(decInfo.size_secret_file + 1);
+            if (payload && decode_payload_range(0, decInfo.size_secret_file, payload, &decInfo) == e_success &&
+                decInfo.has_digest)
+            {
+                check_payload_digest(payload, decInfo.size_secret_file, &decInfo);
+            }
+            free(payload);
+        }
+    }
+
+    free(decInfo.fec_payload);
+    free_run_index(&decInfo.runs);
+    free_archive_index(&decInfo.archive);
+    free_adaptive_map(&decInfo.adaptive);
+    cover_close(&decInfo.stego_cover);
+    fclose(decInfo.fptr_stego_image);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+/* Flip bits (often just the LSB that carries the stego header), overwrite bytes or cut the tail,
+ * more often near the start where the headers are */
+static void mutate(uint8_t *data, size_t *size)
+{
+    int edits = 1 + rand() % 8;
+    for (int e = 0; e < edits && *size > 1; e++)
+    {
+        size_t limit = rand() % 2 ? *size : (*size < 1024 ? *size : 1024);
+        size_t at = rand() % limit;
+        switch (rand() % 5)
+        {
+            case 0:
+                data[at] ^= 1u << (rand() % 8);
+                break;
+            case 1:
+                data[at] = rand();
+                break;
+            case 2:
+                data[at] = rand() % 2 ? 0xff : 0;
+                break;
+            case 3:
+                data[at] ^= 1;
+                break;
+            default:
+                if (rand() % 8 == 0)
+                    *size = at + 1;
+                break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int mutations = 200;
+    unsigned seed = 1;
+    int files = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            mutations = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 0);
+            continue;
+        }
+
+        FILE *fptr = fopen(argv[i], "rb");
+        if (!fptr)
+        {
+            perror(argv[i]);
+            return 1;
+        }
+        fseek(fptr, 0, SEEK_END);
+        size_t size = ftell(fptr);
+        rewind(fptr);
+        uint8_t *input = malloc(size + 1);
+        uint8_t *work = malloc(size + 1);
+        if (!input || !work || fread(input, 1, size, fptr) != size)
+        {
+            fprintf(stderr, "%s: unable to read\n", argv[i]);
+            return 1;
+        }
+        fclose(fptr);
+
+        LLVMFuzzerTestOneInput(input, size);
+        srand(seed + files);
+        for (int m = 0; m < mutations; m++)
+        {
+            size_t n = size;
+            memcpy(work, input, size);
+            mutate(work, &n);
+            LLVMFuzzerTestOneInput(work, n);
+        }
+        free(input);
+        free(work);
+        files++;
+    }
+    fprintf(stderr, "fuzz_decode: %d files, %d mutations each, seed %u\n", files, mutations, seed);
+    return 0;
+}
+
+#endif
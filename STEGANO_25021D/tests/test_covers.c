@@ -0,0 +1,236 @@
+/*
+Shared helpers of the tests: a seeded generator and writers for
+synthetic covers in every supported format.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "test_covers.h"
+
+int test_failures = 0;
+
+static uint rand_state = 1;
+
+void test_srand(uint seed)
+{
+    rand_state = seed ? seed : 1;
+}
+
+/* xorshift32 */
+uint test_rand(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+long test_range(long lo, long hi)
+{
+    return lo + (long)(test_rand() % (uint)(hi - lo + 1));
+}
+
+void test_fill(unsigned char *buf, long n)
+{
+    for (long i = 0; i < n; i++)
+        buf[i] = test_rand() >> 24;
+}
+
+unsigned char *test_pixels(uint width, uint height, int bpp)
+{
+    unsigned char *pixels = malloc((size_t)width * height * bpp);
+    if (!pixels)
+        return NULL;
+
+    for (uint y = 0; y < height; y++)
+    {
+        for (uint x = 0; x < width; x++)
+        {
+            for (int c = 0; c < bpp; c++)
+            {
+                unsigned char *p = pixels + ((size_t)y * width + x) * bpp + c;
+                if (x < width / 3 && y < height / 3)
+                    *p = 90 + 40 * c;                              // flat
+                else if (x < width / 2)
+                    *p = (x * 3 + y * 2 + c * 50) & 0xff;           // gradient
+                else
+                    *p = (x * 7 + y * 5 + c * 30 + (test_rand() >> 26)) & 0xff;   // noise
+            }
+        }
+    }
+    return pixels;
+}
+
+static void put16(unsigned char *p, uint v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(unsigned char *p, uint v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static void put32be(unsigned char *p, uint v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static Status write_bmp(FILE *fptr, const unsigned char *pixels, uint width, uint height, int bpp)
+{
+    long stride = ((long)width * bpp + 3) & ~3L;
+    unsigned char header[54] = {'B', 'M'};
+    put32(header + 2, 54 + stride * height);
+    put32(header + 10, 54);
+    put32(header + 14, 40);
+    put32(header + 18, width);
+    put32(header + 22, height);
+    put16(header + 26, 1);
+    put16(header + 28, bpp * 8);
+    put32(header + 34, stride * height);
+    if (fwrite(header, 1, sizeof(header), fptr) != sizeof(header))
+        return e_failure;
+
+    // Bottom-up rows, zero padded to 4 bytes
+    unsigned char *row = calloc(stride, 1);
+    if (!row)
+        return e_failure;
+    Status ret = e_success;
+    for (uint y = height; y-- > 0 && ret == e_success;)
+    {
+        memcpy(row, pixels + (size_t)y * width * bpp, (size_t)width * bpp);
+        if (fwrite(row, 1, stride, fptr) != (size_t)stride)
+            ret = e_failure;
+    }
+    free(row);
+    return ret;
+}
+
+static Status write_png_chunk(FILE *fptr, const char *type, const unsigned char *data, uint len)
+{
+    unsigned char hdr[8], crc[4];
+    uLong sum = crc32(crc32(0L, Z_NULL, 0), (const Bytef *)type, 4);
+    sum = crc32(sum, data, len);
+    put32be(hdr, len);
+    memcpy(hdr + 4, type, 4);
+    put32be(crc, sum);
+    return fwrite(hdr, 1, 8, fptr) == 8 && fwrite(data, 1, len, fptr) == len &&
+           fwrite(crc, 1, 4, fptr) == 4 ? e_success : e_failure;
+}
+
+static Status write_png(FILE *fptr, const unsigned char *pixels, uint width, uint height, int bpp)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    unsigned char ihdr[13] = {0};
+    put32be(ihdr, width);
+    put32be(ihdr + 4, height);
+    ihdr[8] = 8;
+    ihdr[9] = bpp == 3 ? 2 : 6;
+
+    // Filter type 0 on every row
+    long row_bytes = (long)width * bpp + 1;
+    uLong raw_size = row_bytes * height;
+    unsigned char *raw = malloc(raw_size);
+    uLong packed_size = compressBound(raw_size);
+    unsigned char *packed = malloc(packed_size);
+    Status ret = raw && packed ? e_success : e_failure;
+    if (ret == e_success)
+    {
+        for (uint y = 0; y < height; y++)
+        {
+            raw[y * row_bytes] = 0;
+            memcpy(raw + y * row_bytes + 1, pixels + (size_t)y * width * bpp, row_bytes - 1);
+        }
+        if (compress(packed, &packed_size, raw, raw_size) != Z_OK ||
+            fwrite(signature, 1, 8, fptr) != 8 ||
+            write_png_chunk(fptr, "IHDR", ihdr, sizeof(ihdr)) != e_success ||
+            write_png_chunk(fptr, "IDAT", packed, packed_size) != e_success ||
+            write_png_chunk(fptr, "IEND", ihdr, 0) != e_success)
+        {
+            ret = e_failure;
+        }
+    }
+    free(raw);
+    free(packed);
+    return ret;
+}
+
+static Status write_tga(FILE *fptr, const unsigned char *pixels, uint width, uint height, int bpp)
+{
+    unsigned char header[18] = {0};
+    header[2] = bpp == 1 ? 3 : 2;
+    put16(header + 12, width);
+    put16(header + 14, height);
+    header[16] = bpp * 8;
+    header[17] = 0x20;      // top-down
+    size_t n = (size_t)width * height * bpp;
+    return fwrite(header, 1, sizeof(header), fptr) == sizeof(header) &&
+           fwrite(pixels, 1, n, fptr) == n ? e_success : e_failure;
+}
+
+Status test_write_cover(const char *fname, uint width, uint height, int bpp)
+{
+    const char *suffix = strrchr(fname, '.');
+    unsigned char *pixels = test_pixels(width, height, bpp);
+    FILE *fptr = fopen(fname, "wb");
+    Status ret = pixels && fptr && suffix ? e_success : e_failure;
+    size_t n = (size_t)width * height * bpp;
+
+    if (ret == e_success)
+    {
+        if (strcmp(suffix, ".bmp") == 0)
+            ret = write_bmp(fptr, pixels, width, height, bpp);
+        else if (strcmp(suffix, ".png") == 0)
+            ret = write_png(fptr, pixels, width, height, bpp);
+        else if (strcmp(suffix, ".tga") == 0)
+            ret = write_tga(fptr, pixels, width, height, bpp);
+        else if (strcmp(suffix, ".ppm") == 0 || strcmp(suffix, ".pgm") == 0)
+            ret = fprintf(fptr, "%s\n%u %u\n255\n", bpp == 1 ? "P5" : "P6", width, height) > 0 &&
+                  fwrite(pixels, 1, n, fptr) == n ? e_success : e_failure;
+        else if (strcmp(suffix, ".raw") == 0)
+            ret = fwrite(pixels, 1, n, fptr) == n ? e_success : e_failure;
+        else
+            ret = e_failure;
+    }
+
+    if (fptr && fclose(fptr) != 0)
+        ret = e_failure;
+    free(pixels);
+    return ret;
+}
+
+Status test_write_file(const char *fname, const unsigned char *data, long n)
+{
+    FILE *fptr = fopen(fname, "wb");
+    if (!fptr)
+        return e_failure;
+    Status ret = fwrite(data, 1, n, fptr) == (size_t)n ? e_success : e_failure;
+    if (fclose(fptr) != 0)
+        ret = e_failure;
+    return ret;
+}
+
+unsigned char *test_read_file(const char *fname, long *n)
+{
+    FILE *fptr = fopen(fname, "rb");
+    if (!fptr)
+        return NULL;
+    fseek(fptr, 0, SEEK_END);
+    *n = ftell(fptr);
+    rewind(fptr);
+    unsigned char *data = malloc(*n + 1);
+    if (data && fread(data, 1, *n, fptr) != (size_t)*n)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(fptr);
+    return data;
+}
@@ -0,0 +1,47 @@
+#ifndef TEST_COVERS_H
+#define TEST_COVERS_H
+
+#include <stdio.h>
+#include "../types.h"
+
+/* Report a failed check with its location, the test keeps going */
+#define CHECK(cond)                                                            \
+    do                                                                         \
+    {                                                                          \
+        if (!(cond))                                                           \
+        {                                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+extern int test_failures;
+
+/* Small deterministic generator, every test takes its seed from the command line */
+uint test_rand(void);
+void test_srand(uint seed);
+
+/* Random integer in [lo, hi] */
+long test_range(long lo, long hi);
+
+/* Fill buf with random bytes */
+void test_fill(unsigned char *buf, long n);
+
+/*
+ * Synthetic pixels: a flat block, a gradient and noise, so adaptive
+ * embedding and the detectors see both smooth and textured areas.
+ * Rows are top-down, width * bpp bytes each.
+ */
+unsigned char *test_pixels(uint width, uint height, int bpp);
+
+/* Write a cover of the format its suffix names (.bmp .png .ppm .pgm .tga .raw).
+ * bpp: BMP 3/4, PNG 3/4, PPM 3, PGM 1, TGA 1/3/4, RAW 1-4 */
+Status test_write_cover(const char *fname, uint width, uint height, int bpp);
+
+/* Write n random bytes to fname */
+Status test_write_file(const char *fname, const unsigned char *data, long n);
+
+/* Read a whole file, caller frees, NULL if missing */
+unsigned char *test_read_file(const char *fname, long *n);
+
+#endif
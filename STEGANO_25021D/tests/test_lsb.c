@@ -0,0 +1,188 @@
+/*
+Kernel test: every specialised embed/extract instance in lsb.c, and the
+flat kernels of every pixel size, against the reference bit loops.
+One bit per channel is checked against encode_byte_to_lsb and
+decode_byte_from_lsb themselves, which define the format. 2 and 4 bit
+kernels (not reachable from the command line) are checked against the
+same MSB first spreading with 'bits' bits per carrier. Lengths cover
+whole periods, a zero padded last period and bytes past the end that
+must stay untouched.
+
+Usage: test_lsb [rounds] [seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../lsb.h"
+#include "../encode.h"
+#include "../decode.h"
+#include "test_covers.h"
+
+#define MAX_DATA 97
+#define GUARD 16
+
+/* Reference embed: data bits MSB first, 'bits' per carrier, carriers in pixel then channel order */
+static void reference_embed(const LsbKernel *kernel, const unsigned char *data, long n, unsigned char *pixels)
+{
+    long image_bytes = lsb_image_bytes_for(kernel, n);
+    long bit = 0;
+    uint low = (1u << kernel->bits) - 1;
+
+    for (long i = 0; i < image_bytes; i++)
+    {
+        if (!(kernel->channel_mask & (1u << (i % kernel->bpp))))
+            continue;
+        uint value = 0;
+        for (int b = 0; b < kernel->bits; b++, bit++)
+        {
+            // Past the data: the padding of the last period is zero
+            int set = bit < n * 8 ? (data[bit / 8] >> (7 - bit % 8)) & 1 : 0;
+            value = (value << 1) | set;
+        }
+        pixels[i] = (pixels[i] & ~low) | value;
+    }
+}
+
+/* 1-bit layouts through the reference byte loops of encode.c / decode.c */
+static void byte_loop_embed(const LsbKernel *kernel, const unsigned char *data, long n, unsigned char *pixels)
+{
+    long image_bytes = lsb_image_bytes_for(kernel, n);
+    long carriers[8 * (MAX_DATA + 3)];
+    long count = 0;
+
+    for (long i = 0; i < image_bytes; i++)
+    {
+        if (kernel->channel_mask & (1u << (i % kernel->bpp)))
+            carriers[count++] = i;
+    }
+    for (long k = 0; k < count / 8; k++)
+    {
+        char buffer[8];
+        for (int j = 0; j < 8; j++)
+            buffer[j] = pixels[carriers[k * 8 + j]];
+        encode_byte_to_lsb(k < n ? data[k] : 0, buffer);
+        for (int j = 0; j < 8; j++)
+            pixels[carriers[k * 8 + j]] = buffer[j];
+    }
+}
+
+static void byte_loop_extract(const LsbKernel *kernel, const unsigned char *pixels, long n, unsigned char *data)
+{
+    long carrier = 0;
+    char buffer[8];
+    int filled = 0;
+
+    for (long i = 0; carrier < n * 8; i++)
+    {
+        if (!(kernel->channel_mask & (1u << (i % kernel->bpp))))
+            continue;
+        buffer[filled++] = pixels[i];
+        carrier++;
+        if (filled == 8)
+        {
+            data[carrier / 8 - 1] = decode_byte_from_lsb(buffer);
+            filled = 0;
+        }
+    }
+}
+
+/* One kernel over every length up to MAX_DATA, returns the number of failed checks */
+static int check_kernel(const LsbKernel *kernel, const char *name)
+{
+    int failures = test_failures;
+    unsigned char data[MAX_DATA], back[MAX_DATA];
+    long max_bytes = lsb_image_bytes_for(kernel, MAX_DATA) + GUARD;
+    unsigned char *cover = malloc(max_bytes);
+    unsigned char *fast = malloc(max_bytes);
+    unsigned char *slow = malloc(max_bytes);
+
+    for (long n = 0; n <= MAX_DATA; n++)
+    {
+        test_fill(cover, max_bytes);
+        test_fill(data, n);
+        memcpy(fast, cover, max_bytes);
+        memcpy(slow, cover, max_bytes);
+
+        lsb_embed(kernel, data, n, fast);
+        reference_embed(kernel, data, n, slow);
+        CHECK(memcmp(fast, slow, max_bytes) == 0);
+
+        // Bytes after the last period are never touched
+        long image_bytes = lsb_image_bytes_for(kernel, n);
+        CHECK(memcmp(fast + image_bytes, cover + image_bytes, max_bytes - image_bytes) == 0);
+
+        memset(back, 0, sizeof(back));
+        lsb_extract(kernel, fast, n, back);
+        CHECK(memcmp(back, data, n) == 0);
+
+        if (kernel->bits == 1)
+        {
+            memcpy(slow, cover, max_bytes);
+            byte_loop_embed(kernel, data, n, slow);
+            CHECK(memcmp(fast, slow, max_bytes) == 0);
+
+            memset(back, 0, sizeof(back));
+            byte_loop_extract(kernel, fast, n, back);
+            CHECK(memcmp(back, data, n) == 0);
+        }
+    }
+
+    free(cover);
+    free(fast);
+    free(slow);
+    if (test_failures != failures)
+        fprintf(stderr, "  %s failed\n", name);
+    return test_failures != failures;
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 4;
+    uint seed = argc > 2 ? strtoul(argv[2], NULL, 0) : (uint)time(NULL);
+    int kernels = 0, failed = 0;
+    LsbKernel kernel;
+    char name[64];
+
+    fprintf(stderr, "test_lsb: %d rounds, seed %u\n", rounds, seed);
+    test_srand(seed);
+
+    for (int round = 0; round < rounds; round++)
+    {
+        // Partial channel masks, one instance each
+        for (int i = 0; i < lsb_instance_count(); i++)
+        {
+            if (lsb_instance_kernel(i, &kernel) != e_success)
+            {
+                fprintf(stderr, "  instance %d is not the kernel selected for its layout\n", i);
+                test_failures++;
+                continue;
+            }
+            snprintf(name, sizeof(name), "instance %d (bits %d, bpp %d, mask %x)", i, kernel.bits, kernel.bpp, kernel.channel_mask);
+            failed += check_kernel(&kernel, name);
+            kernels += round == 0;
+        }
+
+        // Full masks use the flat kernels, whatever the pixel size
+        for (int bits = 1; bits <= 4; bits *= 2)
+        {
+            for (int bpp = 1; bpp <= 4; bpp++)
+            {
+                CHECK(lsb_select_kernel(bits, bpp, (1u << bpp) - 1, &kernel) == e_success);
+                snprintf(name, sizeof(name), "flat kernel (bits %d, bpp %d)", bits, bpp);
+                failed += check_kernel(&kernel, name);
+                kernels += round == 0;
+            }
+        }
+    }
+
+    // Layouts without an instance must be refused
+    CHECK(lsb_select_kernel(3, 3, 1, &kernel) == e_failure);
+    CHECK(lsb_select_kernel(1, 2, 1, &kernel) == e_failure);
+    CHECK(lsb_select_kernel(1, 3, 0, &kernel) == e_failure);
+    CHECK(lsb_select_kernel(1, 3, 8, &kernel) == e_failure);
+
+    fprintf(stderr, "test_lsb: %d kernels, %s\n", kernels, test_failures ? "FAILED" : "passed");
+    return test_failures != 0;
+}
@@ -0,0 +1,467 @@
+/*
+Round-trip test over random covers, payload sizes and extensions.
+Every case writes a synthetic cover in one of the formats, encodes a
+random secret (or an archive of several) with one of the layouts,
+decodes and compares it (for FEC also after damaging the payload
+within what it corrects), then updates the image with a new payload of
+another size and decodes again. Commands go through the same option
+parsers and entry points as main.c.
+
+Usage: test_roundtrip [cases] [seed] [--corpus <dir>] [-v]
+--corpus keeps every stego image as a seed for fuzz_decode.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include "../encode.h"
+#include "../decode.h"
+#include "../update.h"
+#include "../verify.h"
+#include "../fec.h"
+#include "test_covers.h"
+
+#define MAX_ARGS 24
+#define MAX_SECRETS 4
+
+typedef enum
+{
+    e_layout_flat,
+    e_layout_region,
+    e_layout_fec,
+    e_layout_archive,
+    e_layout_adaptive,
+    e_layout_verify,
+    e_layout_count
+} Layout;
+
+static const char *layout_names[] = {"flat", "region", "fec", "archive", "adaptive", "verify"};
+
+/* Formats with the pixel sizes the test writes them in, same order as fuzz_decode */
+static const struct
+{
+    const char *suffix;
+    int bpp[4];
+    int nbpp;
+} formats[] = {
+    {".bmp", {3, 4}, 2},
+    {".png", {3, 4}, 2},
+    {".ppm", {3}, 1},
+    {".pgm", {1}, 1},
+    {".tga", {1, 3, 4}, 3},
+    {".raw", {1, 2, 3, 4}, 4},
+};
+
+static const char *extensions[] = {".txt", ".c", ".sh", ".pdf", ".cpp"};
+
+static const char *corpus_dir = NULL;
+static int cases_run = 0;
+
+/* Split a command line and run it the way main does, options first */
+static Status run_command(const char *command)
+{
+    char line[1024];
+    char *argv[MAX_ARGS + 1];
+    int argc = 0;
+
+    snprintf(line, sizeof(line), "stego %s", command);
+    for (char *tok = strtok(line, " "); tok != NULL && argc < MAX_ARGS; tok = strtok(NULL, " "))
+        argv[argc++] = tok;
+    argv[argc] = NULL;
+
+    int fec_parity, verify;
+    CoverGeometry raw_geometry;
+    AdaptiveMap adaptive;
+    EmbedRegion region;
+    argc = cover_parse_args(argc, argv, &raw_geometry);
+    argc = fec_parse_args(argc, argv, &fec_parity);
+    argc = adaptive_parse_args(argc, argv, &adaptive);
+    argc = verify_parse_args(argc, argv, &verify);
+    argc = region_parse_args(argc, argv, &region);
+
+    if (strcmp(argv[1], "-e") == 0)
+    {
+        EncodeInfo encInfo;
+        encInfo.raw_geometry = raw_geometry;
+        encInfo.region = region;
+        encInfo.fec_parity = fec_parity;
+        encInfo.adaptive = adaptive;
+        encInfo.verify = verify;
+        return read_and_validate_encode_args(argv, &encInfo) == e_success ? do_encoding(&encInfo) : e_failure;
+    }
+    if (strcmp(argv[1], "-d") == 0)
+    {
+        DecodeInfo decInfo;
+        if (read_and_validate_decode_args(argv, &decInfo) != e_success)
+            return e_failure;
+        decInfo.raw_geometry = raw_geometry;
+        decInfo.verify_only = verify;
+        return do_decoding(&decInfo);
+    }
+    if (strcmp(argv[1], "-u") == 0)
+    {
+        UpdateInfo updInfo;
+        if (read_and_validate_update_args(argv, &updInfo) != e_success)
+            return e_failure;
+        updInfo.decInfo.raw_geometry = raw_geometry;
+        return do_update(&updInfo);
+    }
+    return e_failure;
+}
+
+/* The decoded file must hold exactly the secret */
+static int same_file(const char *decoded, const char *secret)
+{
+    long n1 = 0, n2 = 0;
+    unsigned char *a = test_read_file(decoded, &n1);
+    unsigned char *b = test_read_file(secret, &n2);
+    int same = a && b && n1 == n2 && memcmp(a, b, n1) == 0;
+    free(a);
+    free(b);
+    return same;
+}
+
+/* Write 'count' random secrets, names[] get their paths, returns the total size */
+static long make_secrets(int version, int count, long total, char names[][64])
+{
+    long sum = 0;
+    for (int i = 0; i < count; i++)
+    {
+        long n = count == 1 ? total : test_range(1, total / count);
+        unsigned char *data = malloc(n);
+        test_fill(data, n);
+        snprintf(names[i], 64, "in/s%d_%d%s", version, i, extensions[test_range(0, 4)]);
+        CHECK(test_write_file(names[i], data, n) == e_success);
+        free(data);
+        sum += n;
+    }
+    return sum;
+}
+
+/* Decode the stego image and compare with the secrets */
+static void check_decode(const char *stego, const char *raw_arg, int count, char names[][64], const char *what)
+{
+    // Archives go into a directory or get the output name as prefix
+    const char *output = count > 1 && test_rand() & 1 ? "outdir" : "out";
+    if (strcmp(output, "outdir") == 0)
+        CHECK(mkdir(output, 0700) == 0);
+
+    char command[512];
+    snprintf(command, sizeof(command), "-d %s %s %s", stego, output, raw_arg);
+    Status ret = run_command(command);
+    if (ret != e_success)
+    {
+        fprintf(stderr, "  %s: decoding failed\n", what);
+        test_failures++;
+    }
+    // Extracting the archive again must not replace the files
+    else if (count > 1)
+    {
+        CHECK(run_command(command) == e_failure);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        // A single secret is written as out<ext>
+        char decoded[80];
+        if (count == 1)
+            snprintf(decoded, sizeof(decoded), "out%s", strrchr(names[0], '.'));
+        else
+            snprintf(decoded, sizeof(decoded), "%s%s%s", output, output[3] ? "/" : "_", strrchr(names[i], '/') + 1);
+        if (ret == e_success && !same_file(decoded, names[i]))
+        {
+            fprintf(stderr, "  %s: %s does not match %s\n", what, decoded, names[i]);
+            test_failures++;
+        }
+        remove(decoded);
+    }
+    if (output[3])
+        rmdir(output);
+}
+
+/*
+ * Copy stego to damaged with up to parity / 2 consecutive payload bytes
+ * broken: either every carrier LSB flipped or the carrier bytes replaced
+ * by random values (with the LSB still flipped).
+ * Each codeword gets at most that many of them, FEC must undo it.
+ */
+static Status damage_payload(const char *stego, const char *damaged, const char *raw_arg)
+{
+    DecodeInfo decInfo;
+    char *argv[] = {"stego", "-d", (char *)stego, NULL};
+    char *options[] = {(char *)raw_arg, NULL};
+    if (read_and_validate_decode_args(argv, &decInfo) != e_success)
+        return e_failure;
+    cover_parse_args(1, options, &decInfo.raw_geometry);
+    memset(&decInfo.stego_cover, 0, sizeof(decInfo.stego_cover));
+    decInfo.fptr_stego_image = fopen(stego, "rb");
+    if (decInfo.fptr_stego_image == NULL)
+        return e_failure;
+
+    Status ret = decode_stego_header(&decInfo);
+    long start = decInfo.data_start, coded = 0;
+    int parity = decInfo.fec_parity;
+    if (ret == e_success)
+        coded = fec_encoded_size(decInfo.size_secret_file, parity);
+    cover_close(&decInfo.stego_cover);
+    fclose(decInfo.fptr_stego_image);
+    if (ret != e_success || parity == 0)
+        return e_failure;
+
+    // One payload byte per 8 carrier bytes in the flat layout
+    long burst = test_range(1, parity / 2 < coded ? parity / 2 : coded);
+    long at = start + test_range(0, coded - burst) * 8;
+    int overwrite = test_rand() & 1;
+
+    Cover src, dest;
+    unsigned char pixels[MAX_FEC_PARITY / 2 * 8];
+    FILE *in = fopen(stego, "rb"), *out = fopen(damaged, "wb");
+    memset(&src, 0, sizeof(src));
+    memset(&dest, 0, sizeof(dest));
+    ret = in && out ? e_success : e_failure;
+    if (ret == e_success)
+        ret = cover_open(&src, decInfo.stego_format, in, &decInfo.raw_geometry);
+    if (ret == e_success)
+        ret = cover_create(&dest, &src, out);
+    if (ret == e_success)
+        ret = cover_copy(&src, &dest, at);
+    if (ret == e_success && cover_read(&src, pixels, burst * 8) != burst * 8)
+        ret = e_failure;
+    if (ret == e_success)
+    {
+        for (long i = 0; i < burst * 8; i++)
+            pixels[i] = overwrite ? pixels[i] ^ (test_rand() | 1) : pixels[i] ^ 1;
+        ret = cover_write(&dest, pixels, burst * 8);
+    }
+    if (ret == e_success)
+        ret = cover_finish(&dest, &src);
+    cover_close(&src);
+    cover_close(&dest);
+    if (in)
+        fclose(in);
+    if (out && fclose(out) != 0)
+        ret = e_failure;
+    return ret;
+}
+
+static void save_corpus(int format, const char *stego, int index)
+{
+    long n = 0;
+    unsigned char *data = test_read_file(stego, &n);
+    if (!data)
+        return;
+
+    char fname[512];
+    snprintf(fname, sizeof(fname), "%s/rt_%d%s", corpus_dir, index, formats[format].suffix);
+    FILE *fptr = fopen(fname, "wb");
+    if (fptr)
+    {
+        // First byte picks the format, as in fuzz_decode
+        fputc(format, fptr);
+        fwrite(data, 1, n, fptr);
+        fclose(fptr);
+    }
+    free(data);
+}
+
+static void run_case(int index, int format, Layout layout)
+{
+    int bpp = formats[format].bpp[test_range(0, formats[format].nbpp - 1)];
+    uint width = test_range(48, 220), height = test_range(48, 220);
+    char cover[32], stego[32], raw_arg[48] = "", options[160] = "", what[256];
+
+    snprintf(cover, sizeof(cover), "cover%s", formats[format].suffix);
+    snprintf(stego, sizeof(stego), "stego%s", formats[format].suffix);
+    if (strcmp(formats[format].suffix, ".raw") == 0)
+        snprintf(raw_arg, sizeof(raw_arg), "--raw=%ux%ux%d", width, height, bpp);
+    CHECK(test_write_cover(cover, width, height, bpp) == e_success);
+
+    // Rough payload room after the header, kept well below the real capacity
+    long room = (long)width * height * bpp / 8 - 200;
+    int count = 1;
+    switch (layout)
+    {
+        case e_layout_region:
+        {
+            static const char *letters[] = {"", "y", "ya", "bgr", "bgra"};
+            const char *all = letters[bpp];
+            char channels[5];
+            int n = 0;
+            // Partial channel masks need 3 or 4 bytes per pixel
+            for (int c = 0; all[c]; c++)
+            {
+                if (bpp < 3 || test_rand() & 1)
+                    channels[n++] = all[c];
+            }
+            if (n == 0)
+                channels[n++] = all[0];
+            channels[n] = '\0';
+            uint rw = test_range(width / 2, width), rh = test_range(height / 2, height);
+            uint rx = test_range(0, width - rw), ry = test_range(0, height - rh);
+            int step = test_range(1, 2);
+            snprintf(options, sizeof(options), "--channels=%s --region=%u,%u,%u,%u --row-step=%d",
+                     channels, rx, ry, rw, rh, step);
+            room = (long)rw * (rh / step) * n / 8 - 200;
+            break;
+        }
+        case e_layout_fec:
+        {
+            int parity = test_range(1, 32) * 2;
+            snprintf(options, sizeof(options), "--fec=%d", parity);
+            room = room * (255 - parity) / 255 - 255;
+            break;
+        }
+        case e_layout_archive:
+            count = test_range(2, MAX_SECRETS);
+            room -= 64 * count;
+            break;
+        case e_layout_adaptive:
+            // Only the textured part of the cover carries data
+            snprintf(options, sizeof(options), "--adaptive");
+            room /= 4;
+            break;
+        case e_layout_verify:
+            snprintf(options, sizeof(options), test_rand() & 1 ? "--verify" : "--verify --fec=16");
+            room = room * 239 / 255 - 255;
+            break;
+        default:
+            break;
+    }
+    room = room * 3 / 4;
+    snprintf(what, sizeof(what), "case %d: %s %ux%ux%d %s %s", index, formats[format].suffix, width, height, bpp,
+             layout_names[layout], options);
+    if (room < count * 8)
+    {
+        remove(cover);
+        return;
+    }
+
+    // Encode, decode
+    cases_run++;
+    char names[MAX_SECRETS][64], command[1024];
+    make_secrets(1, count, test_range(count, room), names);
+    int len = snprintf(command, sizeof(command), "-e %s", cover);
+    for (int i = 0; i < count; i++)
+        len += snprintf(command + len, sizeof(command) - len, " %s", names[i]);
+    snprintf(command + len, sizeof(command) - len, " %s %s %s", stego, options, raw_arg);
+    if (run_command(command) != e_success)
+    {
+        fprintf(stderr, "  %s: encoding failed\n", what);
+        test_failures++;
+    }
+    else
+    {
+        if (corpus_dir)
+            save_corpus(format, stego, index);
+        check_decode(stego, raw_arg, count, names, what);
+        if (layout == e_layout_fec)
+        {
+            // Damage within the correction limit decodes to the same bytes
+            char damaged[32];
+            snprintf(damaged, sizeof(damaged), "damaged%s", formats[format].suffix);
+            CHECK(damage_payload(stego, damaged, raw_arg) == e_success);
+            check_decode(damaged, raw_arg, count, names, what);
+            remove(damaged);
+        }
+        if (layout == e_layout_verify)
+        {
+            snprintf(command, sizeof(command), "-d %s --verify %s", stego, raw_arg);
+            CHECK(run_command(command) == e_success);
+        }
+
+        // Update with a payload of another size, often shorter than the old one
+        char updated[MAX_SECRETS][64];
+        make_secrets(2, count, test_range(count, test_rand() & 1 ? room : room / 4 + count), updated);
+        len = snprintf(command, sizeof(command), "-u %s", stego);
+        for (int i = 0; i < count; i++)
+            len += snprintf(command + len, sizeof(command) - len, " %s", updated[i]);
+        snprintf(command + len, sizeof(command) - len, " %s", raw_arg);
+        if (run_command(command) != e_success)
+        {
+            fprintf(stderr, "  %s: update failed\n", what);
+            test_failures++;
+        }
+        else
+        {
+            check_decode(stego, raw_arg, count, updated, what);
+        }
+        for (int i = 0; i < count; i++)
+            remove(updated[i]);
+    }
+
+    for (int i = 0; i < count; i++)
+        remove(names[i]);
+    remove(stego);
+
+    // A secret larger than the cover (BMP rows padded to 4 bytes) is refused and leaves no stego image behind
+    if (layout == e_layout_flat)
+    {
+        make_secrets(3, 1, (((long)width * bpp + 3) & ~3L) * height / 8 + 1, names);
+        snprintf(command, sizeof(command), "-e %s %s %s %s", cover, names[0], stego, raw_arg);
+        CHECK(run_command(command) == e_failure);
+        CHECK(access(stego, F_OK) != 0);
+        remove(names[0]);
+    }
+    remove(cover);
+}
+
+int main(int argc, char *argv[])
+{
+    int cases = 0, verbose = 0;
+    uint seed = time(NULL);
+    int positional = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+            corpus_dir = argv[++i];
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = 1;
+        else if (positional++ == 0)
+            cases = atoi(argv[i]);
+        else
+            seed = strtoul(argv[i], NULL, 0);
+    }
+    if (cases <= 0)
+        cases = 3 * (int)(sizeof(formats) / sizeof(formats[0])) * e_layout_count;
+    fprintf(stderr, "test_roundtrip: %d cases, seed %u\n", cases, seed);
+    test_srand(seed);
+
+    // Work in a scratch directory, the library prints its progress to stdout
+    static char corpus_path[PATH_MAX];
+    if (corpus_dir && realpath(corpus_dir, corpus_path) == NULL)
+    {
+        perror(corpus_dir);
+        return 1;
+    }
+    if (corpus_dir)
+        corpus_dir = corpus_path;
+    char dir[] = "/tmp/stego_roundtrip.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0 || mkdir("in", 0700) != 0)
+    {
+        perror("scratch directory");
+        return 1;
+    }
+    if (!verbose)
+        freopen("/dev/null", "w", stdout);
+
+    int nformats = sizeof(formats) / sizeof(formats[0]);
+    for (int i = 0; i < cases; i++)
+    {
+        // Every format/layout pair in turn, sizes and geometry at random
+        int failures = test_failures;
+        run_case(i, i % nformats, (Layout)(i / nformats % e_layout_count));
+        if (test_failures != failures)
+            fprintf(stderr, "  (case %d failed, rerun with: test_roundtrip %d %u -v)\n", i, cases, seed);
+    }
+
+    rmdir("in");
+    chdir("/");
+    rmdir(dir);
+    fprintf(stderr, "test_roundtrip: %d cases run (covers too small skipped), %s\n", cases_run, test_failures ? "FAILED" : "passed");
+    return test_failures != 0;
+}
@@ -0,0 +1,170 @@
+/*
+Thread test: adaptive embedding and the steganalysis report must give
+the same results on one worker thread as on several. The cost map and
+its histogram, the embedded pixels and extracted ranges of the adaptive
+map, and the detector counters of the analysis are compared bit for bit
+over random cover sizes, so tiles split across threads at every kind of
+boundary.
+
+Usage: test_threads [rounds] [seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../adaptive.h"
+#include "../analyze.h"
+#include "../cover.h"
+#include "test_covers.h"
+
+static const int thread_counts[] = {2, 3, 5, 16};
+#define THREAD_COUNTS (int)(sizeof(thread_counts) / sizeof(thread_counts[0]))
+
+static int adaptive_maps = 0;
+
+/* Load the adaptive map of fname on 'threads' threads and embed payload at offset */
+static Status adaptive_run(const char *fname, int threads, long start, const unsigned char *payload, long offset,
+                           long n, AdaptiveMap *map)
+{
+    Cover cover;
+    FILE *fptr = fopen(fname, "rb");
+    Status ret = fptr && cover_open(&cover, cover_format_for(fname), fptr, NULL) == e_success ? e_success : e_failure;
+
+    adaptive_set_threads(threads);
+    memset(map, 0, sizeof(*map));
+    map->enabled = 1;
+    if (ret == e_success)
+        ret = adaptive_load(map, &cover, start);
+    if (ret == e_success)
+    {
+        map->threshold = adaptive_select_threshold(map, offset + n);
+        ret = map->threshold > 0 ? adaptive_embed(map, offset, payload, n) : e_failure;
+    }
+    if (fptr)
+    {
+        cover_close(&cover);
+        fclose(fptr);
+    }
+    return ret;
+}
+
+static void check_adaptive(const char *fname)
+{
+    AdaptiveMap one, many;
+    long start = test_range(0, 400);
+    long offset = test_range(0, 64);
+    long n = test_range(1, 1500);
+    unsigned char *payload = malloc(n);
+    unsigned char *back = malloc(n);
+    test_fill(payload, n);
+
+    if (adaptive_run(fname, 1, start, payload, offset, n, &one) != e_success)
+    {
+        // A cover too smooth for the payload fails the same way on any thread count
+        CHECK(adaptive_run(fname, 16, start, payload, offset, n, &many) != e_success);
+        free_adaptive_map(&many);
+        free_adaptive_map(&one);
+        free(payload);
+        free(back);
+        return;
+    }
+
+    adaptive_maps++;
+    for (int t = 0; t < THREAD_COUNTS; t++)
+    {
+        CHECK(adaptive_run(fname, thread_counts[t], start, payload, offset, n, &many) == e_success);
+        if (many.pixels == NULL)
+            continue;
+        CHECK(memcmp(one.hist, many.hist, sizeof(one.hist)) == 0);
+        CHECK(memcmp(one.cost, many.cost, one.size) == 0);
+        CHECK(memcmp(one.pixels, many.pixels, one.size) == 0);
+
+        // Any sub range comes back out on any thread count
+        long skip = test_range(0, n - 1);
+        memset(back, 0, n);
+        CHECK(adaptive_extract(&many, offset + skip, back, n - skip) == e_success);
+        CHECK(memcmp(back, payload + skip, n - skip) == 0);
+        free_adaptive_map(&many);
+    }
+
+    adaptive_set_threads(1);
+    memset(back, 0, n);
+    CHECK(adaptive_extract(&one, offset, back, n) == e_success);
+    CHECK(memcmp(back, payload, n) == 0);
+    free_adaptive_map(&one);
+    free(payload);
+    free(back);
+}
+
+static Status analyze_run(const char *fname, int threads, const EmbedRegion *region, AnalyzeInfo *anaInfo)
+{
+    analyze_set_threads(threads);
+    memset(anaInfo, 0, sizeof(*anaInfo));
+    anaInfo->image_fname = (char *)fname;
+    anaInfo->format = cover_format_for(fname);
+    anaInfo->region = *region;
+    return do_analysis(anaInfo);
+}
+
+static void check_analyze(const char *fname, uint width, uint height, int bpp)
+{
+    static const char *letters[] = {"", "y", "ya", "bgr", "bgra"};
+    static AnalyzeInfo one, many;
+    EmbedRegion region;
+
+    // Whole image, then a random rectangle
+    memset(&region, 0, sizeof(region));
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1)
+        {
+            region.enabled = 1;
+            strcpy(region.channels, letters[bpp]);
+            region.width = test_range(1, width);
+            region.height = test_range(1, height);
+            region.x = test_range(0, width - region.width);
+            region.y = test_range(0, height - region.height);
+            region.row_step = 1;
+        }
+        CHECK(analyze_run(fname, 1, &region, &one) == e_success);
+        for (int t = 0; t < THREAD_COUNTS; t++)
+        {
+            CHECK(analyze_run(fname, thread_counts[t], &region, &many) == e_success);
+            CHECK(memcmp(one.channel_stats, many.channel_stats, sizeof(one.channel_stats)) == 0);
+            CHECK(memcmp(one.grid_stats, many.grid_stats, sizeof(one.grid_stats)) == 0);
+            CHECK(one.flagged == many.flagged);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 6;
+    uint seed = argc > 2 ? strtoul(argv[2], NULL, 0) : (uint)time(NULL);
+    static const char *suffixes[] = {".bmp", ".png", ".tga"};
+
+    fprintf(stderr, "test_threads: %d rounds, seed %u\n", rounds, seed);
+    test_srand(seed);
+    freopen("/dev/null", "w", stdout);
+
+    char fname[64];
+    for (int round = 0; round < rounds; round++)
+    {
+        const char *suffix = suffixes[round % 3];
+        int bpp = strcmp(suffix, ".tga") == 0 && round % 2 ? 1 : test_range(3, 4);
+        uint width = test_range(17, 400), height = test_range(17, 400);
+
+        snprintf(fname, sizeof(fname), "/tmp/stego_threads_%d%s", (int)getpid(), suffix);
+        CHECK(test_write_cover(fname, width, height, bpp) == e_success);
+        check_adaptive(fname);
+        check_analyze(fname, width, height, bpp);
+        remove(fname);
+    }
+
+    adaptive_set_threads(0);
+    analyze_set_threads(0);
+    fprintf(stderr, "test_threads: %d adaptive maps compared, %s\n", adaptive_maps, test_failures ? "FAILED" : "passed");
+    return test_failures != 0;
+}
@@ -0,0 +1,53 @@
+/*
+TGA cover format.
+Uncompressed true colour (type 2, 24/32-bit BGR(A)) and grayscale
+(type 3, 8-bit) images without a colour map. The pixel stream starts
+after the 18 byte header and the image ID. Rows are bottom-up unless
+bit 5 of the descriptor is set. A TGA 2.0 footer is copied as is.
+*/
+
+#include <stdio.h>
+#include "cover.h"
+
+static Status tga_read_header(Cover *cover)
+{
+    unsigned char header[18];
+
+    rewind(cover->fptr);
+    if (fread(header, 1, sizeof(header), cover->fptr) != sizeof(header))
+        return e_failure;
+
+    int id_length = header[0];
+    int colormap_type = header[1];
+    int image_type = header[2];
+    uint width = header[12] | (header[13] << 8);
+    uint height = header[14] | (header[15] << 8);
+    int depth = header[16];
+    int descriptor = header[17];
+
+    if (colormap_type != 0 || width == 0 || height == 0)
+        return e_failure;
+
+    if (image_type == 2 && (depth == 24 || depth == 32))
+        cover->channels = depth == 24 ? "bgr" : "bgra";
+    else if (image_type == 3 && depth == 8)
+        cover->channels = "y";
+    else
+        return e_failure;
+
+    cover->width = width;
+    cover->height = height;
+    cover->bottom_up = (descriptor & 0x20) == 0;
+    cover->bpp = depth / 8;
+    cover->stride = (long)width * cover->bpp;
+    cover->pixel_bytes = cover->stride * height;
+
+    return plain_cover_init(cover, sizeof(header) + id_length);
+}
+
+const CoverFormat tga_format = {
+    "TGA", ".tga", "stego.tga", 1,
+    tga_read_header, plain_write_header,
+    plain_read, plain_write, plain_seek,
+    plain_finish, plain_release
+};
@@ -15,6 +15,10 @@ typedef enum
 {
     e_encode,
     e_decode,
+    e_list,
+    e_extract,
+    e_update,
+    e_analyze,
     e_unsupported
 } OperationType;
 
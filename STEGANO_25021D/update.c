@@ -0,0 +1,510 @@
+/*
+Incremental payload update.
+The header of the existing stego image fixes the layout (region, FEC,
+extension), so a new version of the payload maps onto exactly the same
+cover spans. The stored payload is compared block by block and only
+blocks that differ are re-embedded, followed by the digest, size and extension
+fields. Only when the file cannot be patched (compressed format, or the
+header layout itself changes) is the image encoded again from scratch.
+Either way the old stored bytes the new payload does not cover are
+overwritten with random bytes, so a shorter payload leaves no readable
+tail of the previous one behind.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "update.h"
+#include "profile.h"
+
+#define RED "\x1B[31m"
+#define GREEN "\x1B[32m"
+#define YELLOW "\x1B[33m"
+#define RESET "\x1B[0m"
+
+Status read_and_validate_update_args(char *argv[], UpdateInfo *updInfo)
+{
+    EncodeInfo *encInfo = &updInfo->encInfo;
+
+    // New payload is validated as for encoding, with the stego image as the cover
+    if (read_and_validate_encode_args(argv, encInfo) != e_success)
+    {
+        return e_failure;
+    }
+    if (encInfo->stego_image_fname != encInfo->src_format->stego_name)
+    {
+        printf(RED "ERROR: Update rewrites %s itself, no output file is taken\n" RESET, argv[2]);
+        return e_failure;
+    }
+
+    char *stego_only[] = {argv[0], argv[1], argv[2], NULL};
+    if (read_and_validate_decode_args(stego_only, &updInfo->decInfo) != e_success)
+    {
+        return e_failure;
+    }
+
+    updInfo->temp_fname = NULL;
+    updInfo->scrub_fname = NULL;
+    updInfo->blocks = 0;
+    updInfo->changed_blocks = 0;
+    return e_success;
+}
+
+/* Patch the pixels carrying n payload bytes, 'skip' bytes into the span at image offset 'offset' */
+static Status update_span(long offset, long skip, const unsigned char *data, long n, DecodeInfo *decInfo)
+{
+    const LsbKernel *kernel = &decInfo->kernel;
+    Cover *cover = &decInfo->stego_cover;
+    long image_offset = offset + lsb_image_bytes_for(kernel, skip);
+    long image_bytes = lsb_image_bytes_for(kernel, n);
+
+    unsigned char *image_buffer = malloc(image_bytes);
+    if (!image_buffer)
+    {
+        return e_failure;
+    }
+
+    Status ret = e_failure;
+    if (cover_seek(cover, image_offset) == e_success &&
+        cover_read(cover, image_buffer, image_bytes) == image_bytes)
+    {
+        lsb_embed(kernel, data, n, image_buffer);
+        if (cover_seek(cover, image_offset) == e_success)
+        {
+            ret = cover_write(cover, image_buffer, image_bytes);
+        }
+    }
+    free(image_buffer);
+    return ret;
+}
+
+/* Fill buf with random bytes from /dev/urandom, fails rather than write guessable filler */
+static Status random_bytes(unsigned char *buf, long n)
+{
+    FILE *fptr = fopen("/dev/urandom", "rb");
+    long got = fptr ? (long)fread(buf, 1, n, fptr) : 0;
+    if (fptr)
+    {
+        fclose(fptr);
+    }
+    if (got != n)
+    {
+        printf(RED "ERROR: Unable to read random bytes from /dev/urandom.\n" RESET);
+        return e_failure;
+    }
+    return e_success;
+}
+
+/* Bytes of the current payload as embedded (RS coded when FEC is on) */
+static long stored_payload_size(DecodeInfo *decInfo)
+{
+    long size = decInfo->size_secret_file;
+    if (decInfo->fec_parity != 0)
+    {
+        size = fec_encoded_size(size, decInfo->fec_parity);
+    }
+    return size;
+}
+
+Status update_block(long start, const unsigned char *data, long n, DecodeInfo *decInfo)
+{
+    if (!decInfo->region.enabled)
+    {
+        return update_span(decInfo->data_start, start, data, n, decInfo);
+    }
+
+    // Blocks are period aligned, so a block may only be split at run ends
+    RunIndex *index = &decInfo->runs;
+    long base = 0;
+    for (long r = 0; r < index->count && n > 0; r++)
+    {
+        long capacity = run_payload_bytes(&index->runs[r], &decInfo->kernel);
+        if (start < base + capacity)
+        {
+            long m = base + capacity - start < n ? base + capacity - start : n;
+            if (update_span(index->runs[r].offset, start - base, data, m, decInfo) != e_success)
+            {
+                return e_failure;
+            }
+            data += m;
+            start += m;
+            n -= m;
+        }
+        base += capacity;
+    }
+    return n == 0 ? e_success : e_failure;
+}
+
+/* Rewrite 'bits' header bits at image offset 'offset' with value (MSB first) */
+static Status update_header_field(long offset, uint value, int bits, DecodeInfo *decInfo)
+{
+    char image_buffer[32];
+    Cover *cover = &decInfo->stego_cover;
+
+    if (cover_seek(cover, offset) != e_success || cover_read(cover, (unsigned char *)image_buffer, bits) != bits)
+    {
+        return e_failure;
+    }
+    if (bits == 32)
+    {
+        encode_uint_to_lsb(value, image_buffer);
+    }
+    else
+    {
+        encode_byte_to_lsb(value, image_buffer);
+    }
+    if (cover_seek(cover, offset) != e_success)
+    {
+        return e_failure;
+    }
+    return cover_write(cover, (unsigned char *)image_buffer, bits);
+}
+
+Status update_in_place(UpdateInfo *updInfo, const unsigned char *payload, long size)
+{
+    DecodeInfo *decInfo = &updInfo->decInfo;
+    EncodeInfo *encInfo = &updInfo->encInfo;
+
+    // Old stored bytes that overlap the new payload, read in one pass
+    long old_size = stored_payload_size(decInfo);
+    long common = old_size < size ? old_size : size;
+    unsigned char *old = malloc(common + 1);
+    if (!old || decode_stored_range(0, common, old, decInfo) != e_success)
+    {
+        printf(RED "ERROR: Unable to read the current payload.\n" RESET);
+        free(old);
+        return e_failure;
+    }
+
+    // A shorter payload is padded with random bytes up to the old size
+    long end = old_size > size ? old_size : size;
+    unsigned char *data = malloc(end);
+    if (!data)
+    {
+        free(old);
+        return e_failure;
+    }
+    memcpy(data, payload, size);
+    if (random_bytes(data + size, end - size) != e_success)
+    {
+        free(data);
+        free(old);
+        return e_failure;
+    }
+
+    for (long start = 0; start < end; start += UPDATE_BLOCK_SIZE)
+    {
+        long n = end - start < UPDATE_BLOCK_SIZE ? end - start : UPDATE_BLOCK_SIZE;
+        updInfo->blocks++;
+
+        // Bytes past the old payload were never written, always embed them
+        if (start + n <= common && memcmp(old + start, data + start, n) == 0)
+        {
+            continue;
+        }
+        if (update_block(start, data + start, n, decInfo) != e_success)
+        {
+            printf(RED "ERROR: Unable to rewrite payload block at %ld.\n" RESET, start);
+            free(data);
+            free(old);
+            return e_failure;
+        }
+        updInfo->changed_blocks++;
+    }
+    free(data);
+    free(old);
+
+    if (decInfo->has_digest && encInfo->payload_digest != decInfo->payload_digest &&
+        update_header_field(decInfo->digest_offset, encInfo->payload_digest, 32, decInfo) != e_success)
+    {
+        printf(RED "ERROR: Unable to rewrite the payload digest.\n" RESET);
+        return e_failure;
+    }
+
+    // Header fields right before the payload: extension, then file size
+    long size_offset = decInfo->data_start - 32;
+    long extn_offset = size_offset - decInfo->extn_size * 8L;
+    if (encInfo->size_secret_file != decInfo->size_secret_file &&
+        update_header_field(size_offset, encInfo->size_secret_file, 32, decInfo) != e_success)
+    {
+        printf(RED "ERROR: Unable to rewrite the secret file size.\n" RESET);
+        return e_failure;
+    }
+    for (int i = 0; i < decInfo->extn_size; i++)
+    {
+        if (encInfo->extn_secret_file[i] != decInfo->extn_secret_file[i] &&
+            update_header_field(extn_offset + i * 8L, (unsigned char)encInfo->extn_secret_file[i], 8, decInfo) != e_success)
+        {
+            printf(RED "ERROR: Unable to rewrite the secret file extension.\n" RESET);
+            return e_failure;
+        }
+    }
+    return e_success;
+}
+
+/*
+ * Copy the cover to scrub up to image offset 'offset', then the pixels of
+ * the next n payload bytes with random bytes embedded, a block at a time
+ */
+static Status scrub_span(Cover *cover, Cover *scrub, long offset, long n, const LsbKernel *kernel)
+{
+    long block = UPDATE_BLOCK_SIZE - UPDATE_BLOCK_SIZE % kernel->period_bytes;
+    if (block == 0)
+    {
+        block = kernel->period_bytes;
+    }
+    unsigned char *noise = malloc(block);
+    unsigned char *image_buffer = malloc(lsb_image_bytes_for(kernel, block));
+    Status ret = noise && image_buffer ? cover_copy(cover, scrub, offset - cover->pos) : e_failure;
+
+    for (long done = 0; ret == e_success && done < n; done += block)
+    {
+        long m = n - done < block ? n - done : block;
+        long image_bytes = lsb_image_bytes_for(kernel, m);
+        if (random_bytes(noise, m) != e_success || cover_read(cover, image_buffer, image_bytes) != image_bytes)
+        {
+            ret = e_failure;
+            break;
+        }
+        lsb_embed(kernel, noise, m, image_buffer);
+        ret = cover_write(scrub, image_buffer, image_bytes);
+    }
+    free(noise);
+    free(image_buffer);
+    return ret;
+}
+
+Status update_scrub_copy(UpdateInfo *updInfo)
+{
+    DecodeInfo *decInfo = &updInfo->decInfo;
+    Cover *cover = &decInfo->stego_cover;
+    long old_size = stored_payload_size(decInfo);
+    const char *stego = decInfo->stego_image_fname;
+
+    updInfo->scrub_fname = malloc(strlen(stego) + 7);
+    if (!updInfo->scrub_fname)
+    {
+        return e_failure;
+    }
+    sprintf(updInfo->scrub_fname, "%s.scrub", stego);
+
+    // Adaptive images already hold the whole pixel stream, the noise goes in there
+    Status ret = e_success;
+    if (decInfo->adaptive.enabled)
+    {
+        unsigned char *noise = malloc(old_size + 1);
+        ret = noise && random_bytes(noise, old_size) == e_success &&
+              adaptive_embed(&decInfo->adaptive, 0, noise, old_size) == e_success ? e_success : e_failure;
+        free(noise);
+    }
+
+    // Same header and trailer, the rest streamed from the image with the payload spans scrubbed
+    FILE *fptr = ret == e_success ? fopen(updInfo->scrub_fname, "wb") : NULL;
+    if (fptr != NULL)
+    {
+        Cover scrub;
+        memset(&scrub, 0, sizeof(scrub));
+        ret = cover_seek(cover, decInfo->adaptive.enabled ? cover->pixel_bytes : 0) == e_success &&
+              cover_create(&scrub, cover, fptr) == e_success ? e_success : e_failure;
+        if (ret == e_success && decInfo->adaptive.enabled)
+        {
+            ret = cover_write(&scrub, decInfo->adaptive.pixels, cover->pixel_bytes);
+        }
+        else if (ret == e_success && decInfo->region.enabled)
+        {
+            RunIndex *index = &decInfo->runs;
+            long done = 0;
+            for (long r = 0; ret == e_success && r < index->count && done < old_size; r++)
+            {
+                long m = run_payload_bytes(&index->runs[r], &decInfo->kernel);
+                m = old_size - done < m ? old_size - done : m;
+                ret = scrub_span(cover, &scrub, index->runs[r].offset, m, &decInfo->kernel);
+                done += m;
+            }
+        }
+        else if (ret == e_success)
+        {
+            ret = scrub_span(cover, &scrub, decInfo->data_start, old_size, &decInfo->kernel);
+        }
+        if (ret == e_success)
+        {
+            ret = cover_finish(&scrub, cover);
+        }
+        cover_close(&scrub);
+        if (fclose(fptr) != 0)
+        {
+            ret = e_failure;
+        }
+    }
+    else
+    {
+        ret = e_failure;
+    }
+
+    if (ret == e_success)
+    {
+        long blocks = (old_size + UPDATE_BLOCK_SIZE - 1) / UPDATE_BLOCK_SIZE;
+        updInfo->blocks += blocks;
+        updInfo->changed_blocks += blocks;
+    }
+    else
+    {
+        printf(RED "ERROR: Unable to overwrite the current payload in %s.\n" RESET, updInfo->scrub_fname);
+        remove(updInfo->scrub_fname);
+        free(updInfo->scrub_fname);
+        updInfo->scrub_fname = NULL;
+    }
+    return ret;
+}
+
+Status update_full_encode(UpdateInfo *updInfo)
+{
+    EncodeInfo *encInfo = &updInfo->encInfo;
+    const char *stego = updInfo->decInfo.stego_image_fname;
+
+    // Encode next to the image, then replace it
+    updInfo->temp_fname = malloc(strlen(stego) + 5);
+    if (!updInfo->temp_fname)
+    {
+        if (updInfo->scrub_fname)
+        {
+            remove(updInfo->scrub_fname);
+        }
+        return e_failure;
+    }
+    sprintf(updInfo->temp_fname, "%s.tmp", stego);
+
+    encInfo->src_image_fname = updInfo->scrub_fname ? updInfo->scrub_fname : (char *)stego;
+    encInfo->stego_image_fname = updInfo->temp_fname;
+    Status ret = do_encoding(encInfo);
+    if (ret == e_success && rename(updInfo->temp_fname, stego) != 0)
+    {
+        perror("rename");
+        ret = e_failure;
+    }
+    if (ret != e_success)
+    {
+        remove(updInfo->temp_fname);
+    }
+    free(updInfo->temp_fname);
+    updInfo->temp_fname = NULL;
+    if (updInfo->scrub_fname)
+    {
+        remove(updInfo->scrub_fname);
+        free(updInfo->scrub_fname);
+        updInfo->scrub_fname = NULL;
+    }
+    return ret;
+}
+
+Status do_update(UpdateInfo *updInfo)
+{
+    DecodeInfo *decInfo = &updInfo->decInfo;
+    EncodeInfo *encInfo = &updInfo->encInfo;
+    int in_place = decInfo->stego_format->in_place;
+
+    decInfo->fptr_stego_image = fopen(decInfo->stego_image_fname, in_place ? "r+b" : "rb");
+    if (decInfo->fptr_stego_image == NULL)
+    {
+        perror("fopen");
+        printf(RED "ERROR: Unable to open stego image file %s\n" RESET, decInfo->stego_image_fname);
+        return e_failure;
+    }
+    if (decode_stego_header(decInfo) != e_success)
+    {
+        fclose(decInfo->fptr_stego_image);
+        return e_failure;
+    }
+
+    // The new payload keeps the layout recorded in the header
+    Cover *cover = &decInfo->stego_cover;
+    memset(&encInfo->region, 0, sizeof(encInfo->region));
+    if (decInfo->region.enabled)
+    {
+        encInfo->region = decInfo->region;
+        int n = 0;
+        for (int c = 0; c < cover->bpp; c++)
+        {
+            if (decInfo->region.channel_mask & (1u << c))
+                encInfo->region.channels[n++] = cover->channels[c];
+        }
+        encInfo->region.channels[n] = '\0';
+    }
+    encInfo->fec_parity = decInfo->fec_parity;
+    encInfo->raw_geometry = decInfo->raw_geometry;
+    memset(&encInfo->adaptive, 0, sizeof(encInfo->adaptive));
+    encInfo->adaptive.enabled = decInfo->adaptive.enabled;
+    encInfo->verify = decInfo->has_digest;
+
+    char *extn = strrchr(encInfo->secret_fname, '.');
+    strcpy(encInfo->extn_secret_file, extn != NULL && strlen(extn) <= MAX_EXTN_SIZE ? extn : "");
+
+    char *payload = NULL;
+    long size;
+    if (open_secret_file(encInfo) != e_success)
+    {
+        fclose(decInfo->fptr_stego_image);
+        return e_failure;
+    }
+    encInfo->size_secret_file = get_file_size(encInfo->fptr_secret);
+    Status ret = read_secret_payload(encInfo, &payload, &size);
+    fclose(encInfo->fptr_secret);
+
+    // Everything after the header can carry payload
+    long capacity = decInfo->adaptive.enabled ? adaptive_capacity(&decInfo->adaptive, 1)
+                  : decInfo->region.enabled ? decInfo->runs.capacity
+                  : (decInfo->image_capacity - decInfo->data_start) / decInfo->kernel.period_image_bytes * decInfo->kernel.period_bytes;
+
+    const char *reason = NULL;
+    if (!in_place)
+        reason = "the cover format is compressed";
+    else if ((long)strlen(encInfo->extn_secret_file) != decInfo->extn_size)
+        reason = "the extension length changed";
+    else if ((encInfo->archive_count > 0) != decInfo->is_archive)
+        reason = "the payload type changed";
+    else if (decInfo->adaptive.enabled)
+        reason = "adaptive carriers depend on the payload size";
+
+    if (ret == e_success && size > capacity)
+    {
+        printf(RED "ERROR: New payload needs %ld bytes, %s holds %ld. Encode it into a larger cover.\n" RESET,
+               size, decInfo->stego_image_fname, capacity);
+        ret = e_failure;
+    }
+    else if (ret == e_success && reason == NULL)
+    {
+        profile_begin("update_in_place", NULL);
+        ret = update_in_place(updInfo, (unsigned char *)payload, size);
+        profile_end(NULL);
+        if (ret == e_success)
+        {
+            printf(GREEN "Rewrote %ld of %ld payload blocks in place.\n" RESET, updInfo->changed_blocks, updInfo->blocks);
+        }
+    }
+    else if (ret == e_success)
+    {
+        // The re-encode uses the image as its cover, so the old payload is overwritten first
+        profile_begin("update_scrub_copy", NULL);
+        ret = update_scrub_copy(updInfo);
+        profile_end(NULL);
+        if (ret == e_success)
+        {
+            printf("Overwrote %ld blocks of the old payload.\n", updInfo->changed_blocks);
+        }
+    }
+    free(payload);
+    free_run_index(&decInfo->runs);
+    free_adaptive_map(&decInfo->adaptive);
+    cover_close(cover);
+    if (fclose(decInfo->fptr_stego_image) != 0)
+    {
+        ret = e_failure;
+    }
+
+    if (ret == e_success && reason != NULL)
+    {
+        printf(YELLOW "Full re-encode: %s.\n" RESET, reason);
+        ret = update_full_encode(updInfo);
+    }
+    return ret;
+}
@@ -0,0 +1,40 @@
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include "types.h"
+#include "encode.h"   // New payload, full re-encode fallback
+#include "decode.h"   // Existing header and layout
+
+/* Payload bytes compared and rewritten as one unit, a multiple of every kernel period */
+#define UPDATE_BLOCK_SIZE 192
+
+typedef struct _UpdateInfo
+{
+    DecodeInfo decInfo;     // Existing stego image, opened for patching
+    EncodeInfo encInfo;     // New payload, with the stego image as the cover
+    char *temp_fname;       // Full re-encode target, renamed over the stego image
+    char *scrub_fname;      // Copy of the stego image with the old payload overwritten, cover of a full re-encode
+    long blocks;            // Payload blocks compared
+    long changed_blocks;    // Blocks rewritten, including those of an old tail or old payload overwritten
+} UpdateInfo;
+
+/* Read and validate -u <stego> <secret>... arguments */
+Status read_and_validate_update_args(char *argv[], UpdateInfo *updInfo);
+
+/* Update the payload of a stego image, in place when the layout allows it */
+Status do_update(UpdateInfo *updInfo);
+
+/* Rewrite the changed blocks and header fields of the existing image */
+Status update_in_place(UpdateInfo *updInfo, const unsigned char *payload, long size);
+
+/* Re-embed payload bytes [start, start + n) into their cover spans */
+Status update_block(long start, const unsigned char *data, long n, DecodeInfo *decInfo);
+
+/* Write scrub_fname, the stego image with its stored payload overwritten by random bytes
+ * (the stego image must still be open, its header decoded) */
+Status update_scrub_copy(UpdateInfo *updInfo);
+
+/* Encode the new payload into a fresh copy of the image (of scrub_fname when set) */
+Status update_full_encode(UpdateInfo *updInfo);
+
+#endif
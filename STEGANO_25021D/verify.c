@@ -0,0 +1,30 @@
+/*
+Payload digest for --verify.
+Shares the CRC-32 used for archive entries, so -l and --verify report
+the same value for the same data.
+*/
+
+#include <string.h>
+#include "verify.h"
+#include "archive.h"
+
+int verify_parse_args(int argc, char *argv[], int *verify)
+{
+    int j = 0;
+
+    *verify = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--verify") == 0)
+            *verify = 1;
+        else
+            argv[j++] = argv[i];
+    }
+    argv[j] = NULL;
+    return j;
+}
+
+uint payload_digest(const unsigned char *data, long size)
+{
+    return archive_checksum(data, size);
+}
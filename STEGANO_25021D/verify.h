@@ -0,0 +1,19 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "types.h"
+
+/*
+ * Payload digest for --verify.
+ * The encoder stores the CRC-32 of the raw secret data (before FEC)
+ * in the stego header, the decoder recomputes it over the extracted
+ * data before anything is written, and -d --verify only checks it.
+ */
+
+/* Parse and strip --verify from argv, returns new argc */
+int verify_parse_args(int argc, char *argv[], int *verify);
+
+/* CRC-32 of 'size' payload bytes, the value stored in the header */
+uint payload_digest(const unsigned char *data, long size);
+
+#endif